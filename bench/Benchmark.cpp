@@ -0,0 +1,153 @@
+#include "Benchmark.h"
+
+#include <level/Level.h>
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+
+dibidab::bench::BenchmarkSuite::BenchmarkSuite(float scale) :
+    scale(scale)
+{
+}
+
+void dibidab::bench::BenchmarkSuite::add(const Benchmark &benchmark)
+{
+    benchmarks.push_back(benchmark);
+}
+
+int dibidab::bench::BenchmarkSuite::scaled(int n) const
+{
+    return std::max(1, int(float(n) * scale));
+}
+
+std::vector<dibidab::bench::BenchmarkResult> dibidab::bench::BenchmarkSuite::run(
+    const std::string &filter,
+    int repetitions,
+    int warmupRepetitions
+) const
+{
+    std::vector<BenchmarkResult> results;
+
+    for (const Benchmark &benchmark : benchmarks)
+    {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        std::cout << benchmark.name << "..." << std::flush;
+
+        std::vector<double> durations;
+        for (int i = 0; i < warmupRepetitions + repetitions; i++)
+        {
+            if (benchmark.setup)
+            {
+                benchmark.setup();
+            }
+            const auto start = std::chrono::steady_clock::now();
+            benchmark.run();
+            const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+            if (benchmark.teardown)
+            {
+                benchmark.teardown();
+            }
+            if (i >= warmupRepetitions)
+            {
+                durations.push_back(duration.count());
+            }
+        }
+        std::sort(durations.begin(), durations.end());
+
+        BenchmarkResult &result = results.emplace_back();
+        result.name = benchmark.name;
+        result.nrOfOperations = benchmark.nrOfOperations;
+        result.repetitions = int(durations.size());
+        if (!durations.empty())
+        {
+            const size_t middle = durations.size() / 2;
+            result.min = durations.front();
+            result.max = durations.back();
+            result.median = durations.size() % 2 == 0 ? (durations[middle - 1] + durations[middle]) * 0.5 : durations[middle];
+            result.mean = std::accumulate(durations.begin(), durations.end(), 0.0) / double(durations.size());
+            result.nanosecondsPerOperation = result.median * 1000000.0 / double(std::max(1, benchmark.nrOfOperations));
+        }
+        std::cout << " median " << result.median << "ms (" << result.nanosecondsPerOperation << "ns/op)" << std::endl;
+    }
+    return results;
+}
+
+int dibidab::bench::runChecks(const std::vector<Check> &checks, const std::string &filter)
+{
+    int nrOfFailedChecks = 0;
+    for (const Check &check : checks)
+    {
+        if (!filter.empty() && check.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        std::cout << check.name << "..." << std::flush;
+        try
+        {
+            check.run();
+            std::cout << " passed" << std::endl;
+        }
+        catch (std::exception &e)
+        {
+            std::cout << " FAILED:\n" << e.what() << std::endl;
+            nrOfFailedChecks++;
+        }
+    }
+    return nrOfFailedChecks;
+}
+
+void dibidab::bench::resultsToJson(const std::vector<BenchmarkResult> &results, json &j)
+{
+    j = json::array();
+    for (const BenchmarkResult &result : results)
+    {
+        j.push_back({
+            { "name", result.name },
+            { "operations", result.nrOfOperations },
+            { "repetitions", result.repetitions },
+            { "min", result.min },
+            { "median", result.median },
+            { "mean", result.mean },
+            { "max", result.max },
+            { "nsPerOperation", result.nanosecondsPerOperation }
+        });
+    }
+}
+
+std::string dibidab::bench::resultsToCsv(const std::vector<BenchmarkResult> &results)
+{
+    std::string csv = "name,operations,repetitions,min,median,mean,max,nsPerOperation\n";
+    for (const BenchmarkResult &result : results)
+    {
+        csv += "\"" + result.name + "\","
+            + std::to_string(result.nrOfOperations) + ","
+            + std::to_string(result.repetitions) + ","
+            + std::to_string(result.min) + ","
+            + std::to_string(result.median) + ","
+            + std::to_string(result.mean) + ","
+            + std::to_string(result.max) + ","
+            + std::to_string(result.nanosecondsPerOperation) + "\n";
+    }
+    return csv;
+}
+
+dibidab::level::Level *dibidab::bench::createBenchLevel(level::Room *room)
+{
+    level::Level *level = new level::Level();
+    level->bSaveOnDestruct = false;
+    // There is no Player in the benchmarks, but the Rooms should still be updated:
+    level->roomSimulationPolicy = [] (const level::Room &)
+    {
+        return level::RoomSimulation::Full;
+    };
+    level->addRoom(room != nullptr ? room : new level::Room());
+    level->initialize();
+    return level;
+}
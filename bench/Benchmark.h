@@ -0,0 +1,124 @@
+#pragma once
+
+#include <json_fwd.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dibidab::level
+{
+    class Level;
+    class Room;
+}
+
+namespace dibidab::bench
+{
+    /**
+     * A repeatable scenario. Only `run` is measured, `setup` and `teardown` are called before and after each repetition.
+     */
+    struct Benchmark
+    {
+        std::string name;
+
+        // Number of operations (spawned entities, emitted events, etc.) done by one call of `run`:
+        int nrOfOperations = 1;
+
+        std::function<void()> setup;
+        std::function<void()> run;
+        std::function<void()> teardown;
+    };
+
+    struct BenchmarkResult
+    {
+        std::string name;
+        int nrOfOperations = 0;
+        int repetitions = 0;
+
+        // In milliseconds, per repetition:
+        double min = 0.0;
+        double median = 0.0;
+        double mean = 0.0;
+        double max = 0.0;
+
+        // Based on the median:
+        double nanosecondsPerOperation = 0.0;
+    };
+
+    class BenchmarkSuite
+    {
+      public:
+        /**
+         * @param scale Multiplier for the amount of work done by the scenarios. Use less than 1 for quick runs (CI).
+         */
+        explicit BenchmarkSuite(float scale = 1.0f);
+
+        void add(const Benchmark &benchmark);
+
+        /**
+         * Returns `n` multiplied by the scale of this suite, but at least 1.
+         */
+        int scaled(int n) const;
+
+        /**
+         * Runs all benchmarks whose name contains `filter`.
+         * Each benchmark is run `warmupRepetitions` times without being measured, and `repetitions` times while being measured.
+         */
+        std::vector<BenchmarkResult> run(const std::string &filter, int repetitions, int warmupRepetitions) const;
+
+      private:
+        float scale;
+        std::vector<Benchmark> benchmarks;
+    };
+
+    /**
+     * A correctness check, run by `dibidab_bench --check` instead of the benchmarks. Throws if the check fails.
+     */
+    struct Check
+    {
+        std::string name;
+        std::function<void()> run;
+    };
+
+    /**
+     * Runs all checks whose name contains `filter`, and prints which ones failed.
+     * Returns the number of failed checks.
+     */
+    int runChecks(const std::vector<Check> &checks, const std::string &filter);
+
+    void resultsToJson(const std::vector<BenchmarkResult> &results, json &j);
+
+    std::string resultsToCsv(const std::vector<BenchmarkResult> &results);
+
+    /**
+     * Creates and initializes a Level with one Room (with a Player), using the templates in bench/assets.
+     * The Level will not save itself on destruction.
+     * @param room The Room to add, or nullptr for a plain `level::Room`.
+     */
+    level::Level *createBenchLevel(level::Room *room = nullptr);
+
+    // Scenarios:
+
+    void addEcsBenchmarks(BenchmarkSuite &suite);
+
+    void addLevelBenchmarks(BenchmarkSuite &suite);
+
+    void addBehaviorBenchmarks(BenchmarkSuite &suite);
+
+    /**
+     * Also checks that Systems with declared access are updated on workers, with the same result as without worker pool.
+     */
+    void addSystemBenchmarks(BenchmarkSuite &suite);
+
+    // Checks:
+
+    /**
+     * Round trips of the compression codecs, entity columns, level journals and input recordings.
+     */
+    void addRoundTripChecks(std::vector<Check> &checks);
+
+    /**
+     * Number of steps, Level time and interpolation alpha of `Level::update()` with a fixed timestep.
+     */
+    void addFixedTimestepChecks(std::vector<Check> &checks);
+}
@@ -0,0 +1,20 @@
+
+description("Used by dibidab_bench to measure spawning, saving and loading of entities.")
+
+persistenceMode(TEMPLATE | ARGS, {
+    "DespawnAfter"
+})
+
+defaultArgs({
+    lifetime = 1000.0,
+    label = "bench"
+})
+
+function create(entity, args)
+
+    setComponents(entity, {
+        DespawnAfter {
+            time = args.lifetime
+        }
+    })
+end
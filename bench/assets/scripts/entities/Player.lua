@@ -0,0 +1,5 @@
+
+description("Created by every Level on initialization. The benchmarks do not need anything from it.")
+
+function create(player)
+end
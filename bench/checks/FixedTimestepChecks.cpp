@@ -0,0 +1,69 @@
+#include "../Benchmark.h"
+
+#include <level/Level.h>
+
+#include <utils/gu_error.h>
+
+#include <memory>
+#include <string>
+
+namespace
+{
+    /**
+     * Updates the Level once, and throws if it did not simulate `expectedUpdates` steps with the expected interpolation alpha.
+     * Powers of 2 are used for the times, so that the accumulated time is exact.
+     */
+    void checkUpdate(dibidab::level::Level &level, double deltaTime, int expectedUpdates, double expectedAlpha)
+    {
+        const double timeBefore = level.getTime();
+        level.update(deltaTime);
+
+        const double fixedDeltaTime = 1.0 / level.getFixedUpdatesPerSecond();
+        const std::string description = "Updating with a delta time of " + std::to_string(deltaTime);
+        if (level.getNrOfUpdatesLastFrame() != expectedUpdates)
+        {
+            throw gu_err(description + " simulated " + std::to_string(level.getNrOfUpdatesLastFrame()) + " steps instead of "
+                + std::to_string(expectedUpdates));
+        }
+        if (level.getTime() - timeBefore != expectedUpdates * fixedDeltaTime)
+        {
+            throw gu_err(description + " did not advance the time of the Level by the simulated steps only");
+        }
+        if (level.getInterpolationAlpha() != expectedAlpha)
+        {
+            throw gu_err(description + " gave an interpolation alpha of " + std::to_string(level.getInterpolationAlpha())
+                + " instead of " + std::to_string(expectedAlpha));
+        }
+    }
+}
+
+void dibidab::bench::addFixedTimestepChecks(std::vector<Check> &checks)
+{
+    checks.push_back({
+        "fixed timestep/accumulation",
+        []
+        {
+            std::unique_ptr<level::Level> level(createBenchLevel());
+            level->setFixedTimestep(64, 4);
+
+            // Less than a step is accumulated:
+            checkUpdate(*level, 1.0 / 128.0, 0, .5);
+            // Together with the accumulated time, exactly one step:
+            checkUpdate(*level, 1.0 / 128.0, 1, 0.0);
+            // Multiple steps per frame:
+            checkUpdate(*level, 3.0 / 64.0 + 1.0 / 256.0, 3, .25);
+            // More than `maxUpdatesPerFrame` steps, the time that could not be caught up with is dropped:
+            checkUpdate(*level, 10.0 / 64.0, 4, .25);
+            checkUpdate(*level, 1.0 / 256.0, 0, .5);
+
+            // Without fixed timestep, every frame updates once with the frame's delta time:
+            level->setFixedTimestep(0);
+            const double timeBefore = level->getTime();
+            level->update(1.0 / 32.0);
+            if (level->getNrOfUpdatesLastFrame() != 1 || level->getTime() - timeBefore != 1.0 / 32.0 || level->getInterpolationAlpha() != 1.0)
+            {
+                throw gu_err("Updating without fixed timestep did not update once with the frame's delta time");
+            }
+        }
+    });
+}
@@ -0,0 +1,339 @@
+#include "../Benchmark.h"
+
+#include <ecs/components/DespawnAfter.dibidab.h>
+#include <ecs/components/Persistent.dibidab.h>
+#include <ecs/components/Player.dibidab.h>
+#include <level/CompressionCodec.h>
+#include <level/Level.h>
+#include <level/LevelJournal.h>
+#include <level/room/EntityColumns.h>
+#include <replay/InputReplay.h>
+
+#include <utils/gu_error.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    using namespace dibidab;
+
+    /**
+     * Repetitive data (that compresses well) mixed with noise (that does not).
+     */
+    std::vector<unsigned char> createCompressibleData(size_t size)
+    {
+        std::vector<unsigned char> data(size);
+        uint32_t random = 12345u;
+        for (size_t i = 0; i < size; i++)
+        {
+            random = random * 1664525u + 1013904223u;
+            data[i] = (i / 256) % 3 == 0 ? (unsigned char) (random >> 24u) : (unsigned char) (i % 17);
+        }
+        return data;
+    }
+
+    void checkCodecRoundTrip(level::level_file::Compression id, const std::vector<unsigned char> &data, int compressionLevel)
+    {
+        const level::CompressionCodec &codec = level::getCompressionCodec(id);
+        const std::string description = std::string(codec.name) + " (level " + std::to_string(compressionLevel) + ", "
+            + std::to_string(data.size()) + " bytes)";
+
+        const std::vector<unsigned char> compressed = codec.compress(data.data(), data.size(), compressionLevel);
+        std::vector<unsigned char> decompressed(data.size());
+        if (!codec.decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size()))
+        {
+            throw gu_err("Could not decompress what " + description + " compressed");
+        }
+        if (decompressed != data)
+        {
+            throw gu_err(description + " did not decompress to the original data");
+        }
+
+        // A wrong size should be detected instead of leaving the output partially written:
+        std::vector<unsigned char> tooLarge(data.size() + 1);
+        if (codec.decompress(compressed.data(), compressed.size(), tooLarge.data(), tooLarge.size()))
+        {
+            throw gu_err(description + " decompressed to more bytes than were compressed");
+        }
+        if (!data.empty())
+        {
+            std::vector<unsigned char> tooSmall(data.size() - 1);
+            if (codec.decompress(compressed.data(), compressed.size(), tooSmall.data(), tooSmall.size()))
+            {
+                throw gu_err(description + " decompressed to fewer bytes than were compressed");
+            }
+        }
+    }
+
+    void createDespawningEntity(level::Room &room, float time, const char *name = nullptr)
+    {
+        const entt::entity e = room.entities.create();
+        room.entities.assign<ecs::DespawnAfter>(e).time = time;
+        room.entities.assign<ecs::Persistent>(e).saveComponents = { "DespawnAfter" };
+        if (name != nullptr)
+        {
+            room.setName(e, name);
+        }
+    }
+
+    /**
+     * Name, time and timer of every entity with a DespawnAfter component, sorted.
+     */
+    std::vector<std::tuple<std::string, float, float>> describeDespawningEntities(level::Room &room)
+    {
+        std::vector<std::tuple<std::string, float, float>> described;
+        room.entities.view<ecs::DespawnAfter>().each([&] (entt::entity e, const ecs::DespawnAfter &despawnAfter)
+        {
+            const char *name = room.getName(e);
+            described.emplace_back(name == nullptr ? "" : name, despawnAfter.time, despawnAfter.timer);
+        });
+        std::sort(described.begin(), described.end());
+        return described;
+    }
+
+    level::Level *loadLevel(const std::string &path)
+    {
+        level::Level *loadedLevel = new level::Level(path.c_str());
+        loadedLevel->bSaveOnDestruct = false;
+        loadedLevel->initialize();
+        return loadedLevel;
+    }
+}
+
+void dibidab::bench::addRoundTripChecks(std::vector<Check> &checks)
+{
+    checks.push_back({
+        "round trip/compression codecs",
+        []
+        {
+            for (const size_t size : { size_t(0), size_t(1), size_t(100), size_t(65536), size_t(1000003) })
+            {
+                const std::vector<unsigned char> data = createCompressibleData(size);
+                checkCodecRoundTrip(level::level_file::Compression::Store, data, -1);
+                checkCodecRoundTrip(level::level_file::Compression::FastLz, data, -1);
+                for (const int compressionLevel : { -1, 0, 1, 9 })
+                {
+                    checkCodecRoundTrip(level::level_file::Compression::Zlib, data, compressionLevel);
+                }
+            }
+        }
+    });
+
+    checks.push_back({
+        "round trip/entity columns",
+        []
+        {
+            constexpr int nrOfEntities = 100;
+
+            entt::registry savedRegistry;
+            std::vector<entt::entity> savedEntities(nrOfEntities);
+            savedRegistry.create(savedEntities.begin(), savedEntities.end());
+
+            std::vector<ecs::Persistent> persistents(nrOfEntities);
+            std::vector<std::string> names(nrOfEntities);
+            level::EntityColumnsWriter writer;
+            for (int i = 0; i < nrOfEntities; i++)
+            {
+                const entt::entity e = savedEntities[i];
+                // DespawnAfter is saved as CBOR, Player only by its presence:
+                ecs::DespawnAfter &despawnAfter = savedRegistry.assign<ecs::DespawnAfter>(e);
+                despawnAfter.time = float(i) * 1.5f;
+                despawnAfter.timer = float(i) * .25f;
+                if (i % 3 == 0)
+                {
+                    savedRegistry.assign<ecs::Player>(e);
+                }
+                ecs::Persistent &persistent = persistents[i];
+                persistent.entityHint = e;
+                persistent.applyTemplateOnLoad = i % 2 == 0 ? "BenchEntity" : "";
+                persistent.data = {{ "lifetime", i }};
+                persistent.saveComponents = { "DespawnAfter", "Player" };
+                if (i % 4 == 0)
+                {
+                    names[i] = "entity " + std::to_string(i);
+                }
+                const char *name = names[i].empty() ? nullptr : names[i].c_str();
+
+                const uint64_t hash = writer.addEntity(e, persistent, name, savedRegistry);
+                if (hash != level::EntityColumnsWriter::getEntityHash(e, persistent, name, savedRegistry))
+                {
+                    throw gu_err("Adding entity #" + std::to_string(i) + " gave another hash than only hashing it");
+                }
+            }
+            std::vector<unsigned char> bytes;
+            writer.write(bytes);
+
+            const level::EntityColumnsReader reader(bytes.data(), bytes.size());
+            if (reader.getNrOfEntities() != nrOfEntities)
+            {
+                throw gu_err("Wrote " + std::to_string(nrOfEntities) + " entities, but read " + std::to_string(reader.getNrOfEntities()));
+            }
+            entt::registry loadedRegistry;
+            std::vector<entt::entity> loadedEntities(nrOfEntities);
+            loadedRegistry.create(loadedEntities.begin(), loadedEntities.end());
+            reader.setComponents(loadedEntities, loadedRegistry);
+
+            for (int row = 0; row < nrOfEntities; row++)
+            {
+                const std::string entityDescription = "Entity #" + std::to_string(row);
+                const std::string *name = reader.getName(row);
+                if (reader.getEntityHint(row) != savedEntities[row]
+                    || reader.getTemplate(row) != persistents[row].applyTemplateOnLoad
+                    || reader.getData(row) != persistents[row].data
+                    || (name == nullptr ? "" : *name) != names[row])
+                {
+                    throw gu_err(entityDescription + " was not read with the same hint, template, data and name");
+                }
+                const entt::entity loaded = loadedEntities[row];
+                if (loaded == entt::null)
+                {
+                    throw gu_err(entityDescription + " was destroyed while setting its components");
+                }
+                const ecs::DespawnAfter &saved = savedRegistry.get<ecs::DespawnAfter>(savedEntities[row]);
+                const ecs::DespawnAfter *despawnAfter = loadedRegistry.try_get<ecs::DespawnAfter>(loaded);
+                if (despawnAfter == nullptr || despawnAfter->time != saved.time || despawnAfter->timer != saved.timer)
+                {
+                    throw gu_err(entityDescription + " did not get the same DespawnAfter component");
+                }
+                if (loadedRegistry.has<ecs::Player>(loaded) != savedRegistry.has<ecs::Player>(savedEntities[row]))
+                {
+                    throw gu_err(entityDescription + " did not get the Player component back");
+                }
+            }
+        }
+    });
+
+    checks.push_back({
+        "round trip/level journal",
+        []
+        {
+            const std::string path = (std::filesystem::temp_directory_path() / "dibidab_check_journal.lvl").string();
+            const std::string journalPath = level::getJournalPath(path.c_str());
+            std::remove(journalPath.c_str());
+            {
+                std::unique_ptr<level::Level> newLevel(createBenchLevel());
+                for (int i = 0; i < 50; i++)
+                {
+                    createDespawningEntity(newLevel->getRoom(0), float(i), i % 10 == 0 ? ("saved " + std::to_string(i)).c_str() : nullptr);
+                }
+                newLevel->save(path.c_str());
+            }
+            std::unique_ptr<level::Level> loadedLevel(loadLevel(path));
+            // The Room records are larger than the zlib compressed level file, but should not be compacted:
+            loadedLevel->maxJournalSizeRatio = 100.0f;
+            level::Room &room = loadedLevel->getRoom(0);
+
+            // The first incremental save after loading writes the whole Room, because the hashes of what was loaded are not known:
+            createDespawningEntity(room, 1000.0f, "first increment");
+            loadedLevel->saveIncremental();
+
+            // The second one only the changes, including components that were changed in place:
+            std::vector<entt::entity> despawningEntities;
+            room.entities.view<ecs::DespawnAfter>().each([&] (entt::entity e, const ecs::DespawnAfter &)
+            {
+                despawningEntities.push_back(e);
+            });
+            int nrOfDestroyedEntities = 0;
+            for (size_t i = 0; i < despawningEntities.size(); i++)
+            {
+                const entt::entity e = despawningEntities[i];
+                if (i % 5 == 0)
+                {
+                    room.entities.destroy(e);
+                    nrOfDestroyedEntities++;
+                }
+                else if (i % 3 == 0)
+                {
+                    room.entities.get<ecs::DespawnAfter>(e).timer += 0.5f;
+                }
+            }
+            for (int i = 0; i < 10; i++)
+            {
+                createDespawningEntity(room, 2000.0f + float(i), i == 0 ? "second increment" : nullptr);
+            }
+            loadedLevel->saveIncremental();
+
+            const std::vector<level::JournalRecord> records = level::readLevelJournal(path.c_str());
+            if (records.size() != 2 || records[0].type != level::JournalRecord::Type::Room
+                || records[1].type != level::JournalRecord::Type::Delta)
+            {
+                throw gu_err("Expected the journal to have a Room record followed by a Delta record, but it has "
+                    + std::to_string(records.size()) + " records");
+            }
+            if (records[1].destroyedEntities.size() != size_t(nrOfDestroyedEntities))
+            {
+                throw gu_err("Destroyed " + std::to_string(nrOfDestroyedEntities) + " entities, but the journal lists "
+                    + std::to_string(records[1].destroyedEntities.size()));
+            }
+
+            const auto expected = describeDespawningEntities(room);
+            loadedLevel.reset(loadLevel(path));
+            const bool bSame = describeDespawningEntities(loadedLevel->getRoom(0)) == expected;
+            loadedLevel.reset();
+
+            std::remove(journalPath.c_str());
+            std::remove(path.c_str());
+            if (!bSame)
+            {
+                throw gu_err("The Level loaded from the level file and its journal differs from the Level that was saved");
+            }
+        }
+    });
+
+    checks.push_back({
+        "round trip/input recording",
+        []
+        {
+            const std::string path = (std::filesystem::temp_directory_path() / "dibidab_check_recording.rec").string();
+            const std::vector<double> deltaTimes = { 1.0 / 60.0, 1.0 / 30.0, 0.25, 1e-6, 1.0 / 144.0 };
+
+            replay::startRecording(path.c_str());
+            const int recordedRandom = std::rand();
+            for (const double deltaTime : deltaTimes)
+            {
+                replay::beginFrame(deltaTime);
+                replay::endFrame();
+            }
+            replay::stopRecording();
+            {
+                // A frame that was cut off (because the game crashed while writing it) should be ignored:
+                std::ofstream out(path, std::ios::binary | std::ios::app);
+                out.write("\1\2\3\4\5", 5);
+            }
+
+            replay::startReplaying(path.c_str());
+            const bool bSameRandom = std::rand() == recordedRandom;
+            std::vector<double> replayedDeltaTimes;
+            double deltaTime = 0.0;
+            while (replay::nextReplayFrame(deltaTime))
+            {
+                replayedDeltaTimes.push_back(deltaTime);
+            }
+            const bool bStoppedReplaying = !replay::isReplaying();
+            replay::stopReplaying();
+            std::remove(path.c_str());
+
+            if (!bSameRandom)
+            {
+                throw gu_err("Replaying did not seed std::rand() with the seed of the recording");
+            }
+            if (replayedDeltaTimes != deltaTimes)
+            {
+                throw gu_err("Recorded " + std::to_string(deltaTimes.size()) + " frames, but replayed "
+                    + std::to_string(replayedDeltaTimes.size()) + " frames, or with other delta times");
+            }
+            if (!bStoppedReplaying)
+            {
+                throw gu_err("Did not stop replaying at the end of the recording");
+            }
+        }
+    });
+}
@@ -0,0 +1,130 @@
+#include "Benchmark.h"
+
+#include <dibidab/headless.h>
+#include <profiling/TimingStats.h>
+
+#include <files/file_utils.h>
+#include <utils/string_utils.h>
+
+#include <json.hpp>
+
+#include <iostream>
+#include <map>
+
+namespace
+{
+    const char *USAGE = R"(Usage: dibidab_bench [options]
+    --output <path>       Write the results to a .json or .csv file.
+    --filter <text>       Only run benchmarks whose name contains <text>.
+    --repetitions <n>     Measured repetitions per benchmark (default 5).
+    --warmup <n>          Unmeasured repetitions per benchmark (default 1).
+    --scale <factor>      Multiplier for the amount of work per benchmark (default 1).
+    --label <text>        Stored in the JSON output, for example a commit hash.
+    --assets <directory>  Directory with the benchmark scripts (default: bench/assets of the source tree).
+    --check               Run the correctness checks (round trips) instead of the benchmarks. Exits with 1 if one fails.
+)";
+
+    std::map<std::string, std::string> parseOptions(int argc, char *argv[])
+    {
+        std::map<std::string, std::string> options;
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            if (!su::startsWith(arg, "--"))
+            {
+                continue;
+            }
+            options[arg.substr(2)] = i + 1 < argc && !su::startsWith(argv[i + 1], "--") ? argv[++i] : "";
+        }
+        return options;
+    }
+
+    std::string getOption(const std::map<std::string, std::string> &options, const char *name, const std::string &defaultValue)
+    {
+        auto it = options.find(name);
+        return it == options.end() ? defaultValue : it->second;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const std::map<std::string, std::string> options = parseOptions(argc, argv);
+    if (options.find("help") != options.end())
+    {
+        std::cout << USAGE;
+        return 0;
+    }
+
+    try
+    {
+        dibidab::headless::Config config;
+        config.assetsDirectory = getOption(options, "assets", DIBIDAB_BENCH_ASSETS_DIRECTORY);
+        dibidab::headless::init(argc, argv, config);
+
+        if (options.find("check") != options.end())
+        {
+            std::vector<dibidab::bench::Check> checks;
+            dibidab::bench::addRoundTripChecks(checks);
+            dibidab::bench::addFixedTimestepChecks(checks);
+
+            const int nrOfFailedChecks = dibidab::bench::runChecks(checks, getOption(options, "filter", ""));
+            if (nrOfFailedChecks > 0)
+            {
+                std::cerr << nrOfFailedChecks << " check(s) failed" << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        const int repetitions = std::stoi(getOption(options, "repetitions", "5"));
+        const int warmupRepetitions = std::stoi(getOption(options, "warmup", "1"));
+        const float scale = std::stof(getOption(options, "scale", "1"));
+
+        dibidab::bench::BenchmarkSuite suite(scale);
+        dibidab::bench::addEcsBenchmarks(suite);
+        dibidab::bench::addLevelBenchmarks(suite);
+        dibidab::bench::addBehaviorBenchmarks(suite);
+        dibidab::bench::addSystemBenchmarks(suite);
+
+        dibidab::profiling::clearAllTimings();
+        const std::vector<dibidab::bench::BenchmarkResult> results = suite.run(
+            getOption(options, "filter", ""), repetitions, warmupRepetitions
+        );
+
+        const std::string outputPath = getOption(options, "output", "");
+        if (outputPath.empty())
+        {
+            return 0;
+        }
+        std::string output;
+        if (su::endsWith(outputPath, ".csv"))
+        {
+            output = dibidab::bench::resultsToCsv(results);
+        }
+        else
+        {
+            json j = {
+                { "label", getOption(options, "label", "") },
+                { "scale", scale },
+                { "repetitions", repetitions },
+#ifdef NDEBUG
+                { "debug", false },
+#else
+                { "debug", true },
+#endif
+            };
+            dibidab::bench::resultsToJson(results, j["benchmarks"]);
+            // Rolling timings recorded by the engine itself during the benchmarks (Level, Room and System updates):
+            dibidab::profiling::timingsToJson(j["timings"]);
+            output = j.dump(2);
+        }
+        fu::writeBinary(outputPath.c_str(), output.data(), output.size());
+        std::cout << "Results written to " << outputPath << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "../Benchmark.h"
+
+#include <behavior/Tree.h>
+#include <behavior/nodes/FunctionalLeafNode.h>
+
+#include <memory>
+
+namespace
+{
+    using dibidab::behavior::Tree;
+    using dibidab::behavior::FunctionalLeafNode;
+
+    /**
+     * Selector -> Sequence -> leaves that finish immediately, optionally followed by a leaf that keeps running.
+     */
+    Tree::Node *createChurnTree(int nrOfLeaves, bool bEndWithRunningLeaf)
+    {
+        Tree::CompositeNode *sequence = new Tree::SequenceNode();
+        for (int i = 0; i < nrOfLeaves; i++)
+        {
+            sequence->addChild(new FunctionalLeafNode());
+        }
+        if (bEndWithRunningLeaf)
+        {
+            sequence->addChild((new FunctionalLeafNode())->setOnEnter([] (FunctionalLeafNode &)
+            {
+                // Keep running until aborted.
+            }));
+        }
+        return (new Tree::SelectorNode())->addChild(sequence);
+    }
+}
+
+void dibidab::bench::addBehaviorBenchmarks(BenchmarkSuite &suite)
+{
+    auto tree = std::make_shared<Tree>();
+
+    const int nrOfEnters = suite.scaled(100000);
+    constexpr int nrOfLeaves = 8;
+
+    suite.add({
+        "behavior/enter finish",
+        nrOfEnters,
+        [tree]
+        {
+            tree->setRootNode(createChurnTree(nrOfLeaves, false));
+        },
+        [tree, nrOfEnters]
+        {
+            Tree::Node *root = tree->getRootNode();
+            for (int i = 0; i < nrOfEnters; i++)
+            {
+                root->enter();
+            }
+        }
+    });
+
+    suite.add({
+        "behavior/enter abort",
+        nrOfEnters,
+        [tree]
+        {
+            tree->setRootNode(createChurnTree(nrOfLeaves, true));
+        },
+        [tree, nrOfEnters]
+        {
+            Tree::Node *root = tree->getRootNode();
+            for (int i = 0; i < nrOfEnters; i++)
+            {
+                root->enter();
+                root->abort();
+            }
+        }
+    });
+}
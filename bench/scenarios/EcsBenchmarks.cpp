@@ -0,0 +1,182 @@
+#include "../Benchmark.h"
+
+#include <ecs/Observer.h>
+#include <ecs/components/DespawnAfter.dibidab.h>
+#include <ecs/systems/TimeOutSystem.h>
+#include <ecs/templates/Template.h>
+#include <level/Level.h>
+#include <reflection/ComponentInfo.h>
+
+#include <utils/gu_error.h>
+
+#include <memory>
+
+namespace
+{
+    struct EcsBenchState
+    {
+        std::unique_ptr<dibidab::level::Level> level;
+        std::vector<entt::entity> entities;
+        std::vector<delegate_method> timeOuts;
+        long long nrOfCallbacks = 0;
+
+        dibidab::level::Room &getRoom()
+        {
+            return level->getRoom(0);
+        }
+    };
+}
+
+void dibidab::bench::addEcsBenchmarks(BenchmarkSuite &suite)
+{
+    auto state = std::make_shared<EcsBenchState>();
+
+    auto createLevel = [state]
+    {
+        state->level.reset(createBenchLevel());
+        state->nrOfCallbacks = 0;
+    };
+    auto deleteLevel = [state]
+    {
+        state->timeOuts.clear();
+        state->entities.clear();
+        state->level.reset();
+    };
+
+    const int nrOfSpawns = suite.scaled(100000);
+    suite.add({
+        "template/spawn lua",
+        nrOfSpawns,
+        createLevel,
+        [state, nrOfSpawns]
+        {
+            ecs::Template &luaTemplate = state->getRoom().getTemplate("BenchEntity");
+            for (int i = 0; i < nrOfSpawns; i++)
+            {
+                luaTemplate.create();
+            }
+        },
+        deleteLevel
+    });
+
+    // Timeouts are spread over one second, all of them are called within 61 updates:
+    const int nrOfTimeOuts = suite.scaled(100000);
+    constexpr int updatesPerSecond = 60;
+    suite.add({
+        "timeouts/update",
+        nrOfTimeOuts,
+        [state, createLevel, nrOfTimeOuts]
+        {
+            createLevel();
+            level::Room &room = state->getRoom();
+            state->timeOuts.reserve(nrOfTimeOuts);
+            for (int i = 0; i < nrOfTimeOuts; i++)
+            {
+                const entt::entity e = room.entities.create();
+                const float seconds = float(1 + i % updatesPerSecond) / float(updatesPerSecond);
+                state->timeOuts.emplace_back(room.getTimeOuts()->unsafeCallAfter(seconds, e, [state]
+                {
+                    state->nrOfCallbacks++;
+                }));
+            }
+        },
+        [state]
+        {
+            for (int i = 0; i <= updatesPerSecond; i++)
+            {
+                state->level->update(1.0 / updatesPerSecond);
+            }
+            if (size_t(state->nrOfCallbacks) != state->timeOuts.size())
+            {
+                throw gu_err("Not all timeouts were called!");
+            }
+        },
+        deleteLevel
+    });
+
+    const int nrOfListeners = suite.scaled(1000);
+    const int nrOfEmits = 100;
+    suite.add({
+        "events/emit lua fan-out",
+        nrOfListeners * nrOfEmits,
+        [state, createLevel, nrOfListeners]
+        {
+            createLevel();
+            level::Room &room = state->getRoom();
+            sol::state_view lua(room.luaEnvironment.lua_state());
+            const sol::protected_function_result result = lua.safe_script(
+                "benchEventSum = 0\n"
+                "for i = 1, " + std::to_string(nrOfListeners) + " do\n"
+                "    onEvent(\"BenchEvent\", function(value) benchEventSum = benchEventSum + value end)\n"
+                "end\n",
+                room.luaEnvironment
+            );
+            if (!result.valid())
+            {
+                throw gu_err(result.get<sol::error>().what());
+            }
+        },
+        [state]
+        {
+            level::Room &room = state->getRoom();
+            for (int i = 0; i < nrOfEmits; i++)
+            {
+                room.events.emit(1, "BenchEvent");
+            }
+        },
+        deleteLevel
+    });
+
+    const int nrOfObservedEntities = suite.scaled(1000);
+    const int nrOfHandlesPerEntity = 4;
+    const int nrOfObserverRounds = 10;
+    suite.add({
+        "observer/callbacks",
+        // Each round constructs and destroys the component once for every entity:
+        nrOfObservedEntities * nrOfHandlesPerEntity * 2 * nrOfObserverRounds,
+        [state, createLevel, nrOfObservedEntities]
+        {
+            createLevel();
+            level::Room &room = state->getRoom();
+
+            const ComponentInfo *info = findComponentInfo<ecs::DespawnAfter>();
+            if (info == nullptr)
+            {
+                throw gu_err("No ComponentInfo found for DespawnAfter");
+            }
+            ecs::Observer &observer = room.getObserverForComponent(*info);
+
+            for (int i = 0; i < nrOfObservedEntities; i++)
+            {
+                const entt::entity e = state->entities.emplace_back(room.entities.create());
+                for (int h = 0; h < nrOfHandlesPerEntity; h++)
+                {
+                    observer.onConstruct(e, [state]
+                    {
+                        state->nrOfCallbacks++;
+                    });
+                    observer.onDestroy(e, [state]
+                    {
+                        state->nrOfCallbacks++;
+                    });
+                }
+            }
+        },
+        [state]
+        {
+            level::Room &room = state->getRoom();
+            for (int round = 0; round < nrOfObserverRounds; round++)
+            {
+                for (entt::entity e : state->entities)
+                {
+                    room.entities.assign<ecs::DespawnAfter>(e);
+                }
+                for (entt::entity e : state->entities)
+                {
+                    room.entities.remove<ecs::DespawnAfter>(e);
+                }
+            }
+        },
+        deleteLevel
+    });
+}
@@ -0,0 +1,75 @@
+#include "../Benchmark.h"
+
+#include <ecs/templates/Template.h>
+#include <level/Level.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+
+namespace
+{
+    struct LevelBenchState
+    {
+        std::unique_ptr<dibidab::level::Level> level;
+        std::string path = (std::filesystem::temp_directory_path() / "dibidab_bench.lvl").string();
+    };
+
+    void spawnPersistentEntities(dibidab::level::Level &level, int nrOfEntities)
+    {
+        dibidab::ecs::Template &luaTemplate = level.getRoom(0).getTemplate("BenchEntity");
+        for (int i = 0; i < nrOfEntities; i++)
+        {
+            luaTemplate.create(true);
+        }
+    }
+}
+
+void dibidab::bench::addLevelBenchmarks(BenchmarkSuite &suite)
+{
+    auto state = std::make_shared<LevelBenchState>();
+
+    const int nrOfEntities = suite.scaled(10000);
+
+    suite.add({
+        "level/save",
+        nrOfEntities,
+        [state, nrOfEntities]
+        {
+            state->level.reset(createBenchLevel());
+            spawnPersistentEntities(*state->level, nrOfEntities);
+        },
+        [state]
+        {
+            state->level->save(state->path.c_str());
+        },
+        [state]
+        {
+            state->level.reset();
+            std::remove(state->path.c_str());
+        }
+    });
+
+    suite.add({
+        "level/load",
+        nrOfEntities,
+        [state, nrOfEntities]
+        {
+            std::unique_ptr<level::Level> toSave(createBenchLevel());
+            spawnPersistentEntities(*toSave, nrOfEntities);
+            toSave->save(state->path.c_str());
+        },
+        [state]
+        {
+            // Same as what dibidab::setLevel() does:
+            state->level = std::make_unique<level::Level>(state->path.c_str());
+            state->level->bSaveOnDestruct = false;
+            state->level->initialize();
+        },
+        [state]
+        {
+            state->level.reset();
+            std::remove(state->path.c_str());
+        }
+    });
+}
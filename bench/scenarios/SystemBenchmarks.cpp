@@ -0,0 +1,171 @@
+#include "../Benchmark.h"
+
+#include <ecs/systems/System.h>
+#include <level/Level.h>
+#include <threading/WorkerPool.h>
+
+#include <utils/gu_error.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace
+{
+    // Every system writes its own component, so that they can all be updated at the same time:
+    template<int I>
+    struct BenchValue
+    {
+        double value = 1.0;
+    };
+
+    template<int I>
+    class BenchValueSystem : public dibidab::ecs::System
+    {
+      public:
+        explicit BenchValueSystem(std::atomic<bool> &bUpdatedOnWorker) :
+            System("bench values " + std::to_string(I)),
+            bUpdatedOnWorker(bUpdatedOnWorker)
+        {
+        }
+
+      protected:
+        void init(dibidab::ecs::Engine *) override
+        {
+            writesComponents<BenchValue<I>>();
+        }
+
+        void update(double deltaTime, dibidab::ecs::Engine *engine) override
+        {
+            if (dibidab::threading::isWorkerThread())
+            {
+                bUpdatedOnWorker = true;
+            }
+            engine->entities.view<BenchValue<I>>().each([&] (auto, BenchValue<I> &benchValue)
+            {
+                benchValue.value = benchValue.value * (1.0 + (I + 1) * 1e-4) + deltaTime;
+            });
+        }
+
+      private:
+        std::atomic<bool> &bUpdatedOnWorker;
+    };
+
+    class SystemBenchRoom : public dibidab::level::Room
+    {
+      public:
+        explicit SystemBenchRoom(std::atomic<bool> &bUpdatedOnWorker) :
+            bUpdatedOnWorker(bUpdatedOnWorker)
+        {
+        }
+
+      protected:
+        void preLoadInitialize() override
+        {
+            addSystem(new BenchValueSystem<0>(bUpdatedOnWorker));
+            addSystem(new BenchValueSystem<1>(bUpdatedOnWorker));
+            addSystem(new BenchValueSystem<2>(bUpdatedOnWorker));
+            addSystem(new BenchValueSystem<3>(bUpdatedOnWorker));
+            Room::preLoadInitialize();
+        }
+
+      private:
+        std::atomic<bool> &bUpdatedOnWorker;
+    };
+
+    constexpr int NR_OF_BENCH_VALUE_SYSTEMS = 4;
+
+    struct SystemBenchState
+    {
+        std::unique_ptr<dibidab::threading::WorkerPool> pool;
+        // The same Room, updated with and without worker pool, which should give the same results:
+        std::unique_ptr<dibidab::level::Level> parallelLevel, serialLevel;
+        std::atomic<bool> bParallelUpdatedOnWorker { false };
+        std::atomic<bool> bSerialUpdatedOnWorker { false };
+    };
+
+    void createBenchValueEntities(dibidab::level::Room &room, int nrOfEntities)
+    {
+        for (int i = 0; i < nrOfEntities; i++)
+        {
+            const entt::entity e = room.entities.create();
+            room.entities.assign<BenchValue<0>>(e);
+            room.entities.assign<BenchValue<1>>(e);
+            room.entities.assign<BenchValue<2>>(e);
+            room.entities.assign<BenchValue<3>>(e);
+        }
+    }
+
+    template<int I>
+    bool haveSameBenchValues(dibidab::level::Room &a, dibidab::level::Room &b)
+    {
+        bool bSame = a.entities.size<BenchValue<I>>() == b.entities.size<BenchValue<I>>();
+        a.entities.view<BenchValue<I>>().each([&] (entt::entity e, const BenchValue<I> &benchValue)
+        {
+            const BenchValue<I> *other = b.entities.valid(e) ? b.entities.try_get<BenchValue<I>>(e) : nullptr;
+            bSame &= other != nullptr && other->value == benchValue.value;
+        });
+        return bSame;
+    }
+}
+
+void dibidab::bench::addSystemBenchmarks(BenchmarkSuite &suite)
+{
+    auto state = std::make_shared<SystemBenchState>();
+
+    const int nrOfEntities = suite.scaled(100000);
+    constexpr int nrOfUpdates = 60;
+    constexpr double deltaTime = 1.0 / 60.0;
+
+    suite.add({
+        "systems/parallel update",
+        nrOfEntities * NR_OF_BENCH_VALUE_SYSTEMS * nrOfUpdates,
+        [state, nrOfEntities]
+        {
+            if (state->pool == nullptr)
+            {
+                // At least one worker, so that the worker path is used even on a single core machine:
+                state->pool = std::make_unique<threading::WorkerPool>(std::max(1, threading::WorkerPool::getDefaultNrOfThreads() - 1));
+            }
+            state->bParallelUpdatedOnWorker = false;
+            state->bSerialUpdatedOnWorker = false;
+
+            state->parallelLevel.reset(createBenchLevel(new SystemBenchRoom(state->bParallelUpdatedOnWorker)));
+            state->serialLevel.reset(createBenchLevel(new SystemBenchRoom(state->bSerialUpdatedOnWorker)));
+            state->parallelLevel->getRoom(0).setSystemWorkerPool(state->pool.get());
+
+            createBenchValueEntities(state->parallelLevel->getRoom(0), nrOfEntities);
+            createBenchValueEntities(state->serialLevel->getRoom(0), nrOfEntities);
+        },
+        [state]
+        {
+            for (int i = 0; i < nrOfUpdates; i++)
+            {
+                state->parallelLevel->update(deltaTime);
+            }
+        },
+        [state]
+        {
+            for (int i = 0; i < nrOfUpdates; i++)
+            {
+                state->serialLevel->update(deltaTime);
+            }
+            level::Room &parallelRoom = state->parallelLevel->getRoom(0);
+            level::Room &serialRoom = state->serialLevel->getRoom(0);
+            const bool bSameResult = haveSameBenchValues<0>(parallelRoom, serialRoom) && haveSameBenchValues<1>(parallelRoom, serialRoom)
+                && haveSameBenchValues<2>(parallelRoom, serialRoom) && haveSameBenchValues<3>(parallelRoom, serialRoom);
+            const bool bUpdatedOnWorker = state->bParallelUpdatedOnWorker && !state->bSerialUpdatedOnWorker;
+
+            state->parallelLevel.reset();
+            state->serialLevel.reset();
+            if (!bUpdatedOnWorker)
+            {
+                throw gu_err("The systems with declared access were not (only) updated on workers when they should have been!");
+            }
+            if (!bSameResult)
+            {
+                throw gu_err("Updating systems on workers gave a different result than updating them one after another!");
+            }
+        }
+    });
+}
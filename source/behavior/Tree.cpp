@@ -11,14 +11,30 @@
 #include <utils/string_utils.h>
 
 #include <sol/sol.hpp>
-#include <imgui.h>
+
+namespace
+{
+    /**
+     * Nodes created from Lua might be created in a Lua state other than the process-wide one (see Engine::setUsesOwnLuaState()),
+     * so look up the source of the node in the state that is creating it.
+     */
+    template<class NodeType>
+    NodeType *withLuaSource(NodeType *node, sol::this_state lua)
+    {
+        node->setSourceFromLua(lua);
+        return node;
+    }
+}
 
 dibidab::behavior::Tree::Node::Node() :
     parent(nullptr),
     bEntered(false),
     bAborting(false)
 {
-    lua_State *luaState = luau::getLuaState().lua_state();
+}
+
+void dibidab::behavior::Tree::Node::setSourceFromLua(lua_State *luaState)
+{
     lua_Debug luaDebugInfo;
     if (lua_getstack(luaState, 1, &luaDebugInfo))
     {
@@ -631,14 +647,6 @@ const char *dibidab::behavior::Tree::RepeaterNode::getName() const
     return "Repeater";
 }
 
-void dibidab::behavior::Tree::RepeaterNode::drawDebugInfo() const
-{
-    Node::drawDebugInfo();
-#ifndef NDEBUG
-    ImGui::Text("%dx", timesRepeated);
-#endif
-}
-
 void dibidab::behavior::Tree::UnabortableNode::abort()
 {
     if (!isAborting())
@@ -706,9 +714,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto decoratorNodeType = lua->new_usertype<DecoratorNode>(
         "BTDecorator",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new DecoratorNode();
+            return withLuaSource(new DecoratorNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node>(),
@@ -720,9 +728,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto sequenceNodeType = lua->new_usertype<SequenceNode>(
         "BTSequence",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new SequenceNode();
+            return withLuaSource(new SequenceNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, CompositeNode>()
@@ -730,9 +738,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto selectorNodeType = lua->new_usertype<SelectorNode>(
         "BTSelector",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new SelectorNode();
+            return withLuaSource(new SelectorNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, CompositeNode>()
@@ -740,9 +748,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto parallelNodeType = lua->new_usertype<ParallelNode>(
         "BTParallel",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new ParallelNode();
+            return withLuaSource(new ParallelNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, CompositeNode>()
@@ -750,9 +758,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto inverterNodeType = lua->new_usertype<InverterNode>(
         "BTInverter",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new InverterNode();
+            return withLuaSource(new InverterNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, DecoratorNode>()
@@ -760,18 +768,18 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto succeederNodeType = lua->new_usertype<SucceederNode>(
         "BTSucceeder",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new SucceederNode();
+            return withLuaSource(new SucceederNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, DecoratorNode>()
     );
     const auto failNodeType = lua->new_usertype<FailNode>(
         "BTFail",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new FailNode();
+            return withLuaSource(new FailNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, DecoratorNode>()
@@ -779,9 +787,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto repeaterNodeType = lua->new_usertype<RepeaterNode>(
         "BTRepeater",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new RepeaterNode();
+            return withLuaSource(new RepeaterNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, DecoratorNode>(),
@@ -791,9 +799,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto unabortableNodeType = lua->new_usertype<UnabortableNode>(
         "BTUnabortable",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new UnabortableNode();
+            return withLuaSource(new UnabortableNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, DecoratorNode>()
@@ -801,9 +809,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto componentDecoratorNodeType = lua->new_usertype<ComponentDecoratorNode>(
         "BTComponentDecorator",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new ComponentDecoratorNode();
+            return withLuaSource(new ComponentDecoratorNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, DecoratorNode>(),
@@ -844,9 +852,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto waitNodeType = lua->new_usertype<WaitNode>(
         "BTWait",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new WaitNode();
+            return withLuaSource(new WaitNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, LeafNode>(),
@@ -864,9 +872,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto componentObserverNodeType = lua->new_usertype<ComponentObserverNode>(
         "BTComponentObserver",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new ComponentObserverNode();
+            return withLuaSource(new ComponentObserverNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, CompositeNode>(),
@@ -895,9 +903,9 @@ void dibidab::behavior::Tree::addToLuaEnvironment(sol::state *lua)
 
     const auto luaLeafNodeType = lua->new_usertype<LuaLeafNode>(
         "BTLuaLeaf",
-        sol::factories([] ()
+        sol::factories([] (sol::this_state lua)
         {
-            return new LuaLeafNode();
+            return withLuaSource(new LuaLeafNode(), lua);
         }),
         sol::base_classes,
         sol::bases<Node, LeafNode>(),
@@ -6,6 +6,8 @@
 #include <string>
 #include <memory>
 
+struct lua_State;
+
 namespace sol
 {
     class state;
@@ -50,6 +52,12 @@ namespace dibidab::behavior
 
             Node *setDescription(const char *description);
 
+            /**
+             * Stores the Lua source file and line that are currently executing in the given state, if any.
+             * Called by the Lua functions that create nodes, nodes created from C++ have no source.
+             */
+            void setSourceFromLua(lua_State *luaState);
+
             std::string getReadableDebugInfo() const;
 
             virtual const char *getName() const = 0;
@@ -239,8 +247,6 @@ namespace dibidab::behavior
 
             const char *getName() const override;
 
-            void drawDebugInfo() const override;
-
           protected:
             void onChildFinished(Node *child, Result result) override;
 
@@ -251,6 +257,8 @@ namespace dibidab::behavior
 #ifndef NDEBUG
             int timesRepeated = 0;
 #endif
+
+            friend class TreeInspector;
         };
 
         struct UnabortableNode : public DecoratorNode
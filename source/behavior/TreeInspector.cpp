@@ -1,6 +1,9 @@
 #include "TreeInspector.h"
 
+#include "nodes/ComponentDecoratorNode.h"
 #include "nodes/ComponentObserverNode.h"
+#include "nodes/WaitNode.h"
+#include "../level/Level.h"
 
 #include <utils/string_utils.h>
 
@@ -112,6 +115,7 @@ void dibidab::behavior::TreeInspector::drawNode(Tree::Node *node, uint depth)
 
     ImGui::NextColumn();
     ImGui::AlignTextToFramePadding();
+    drawBuiltInNodeDebugInfo(node);
     node->drawDebugInfo();
 
     ImGui::NextColumn();
@@ -136,3 +140,146 @@ void dibidab::behavior::TreeInspector::drawNode(Tree::Node *node, uint depth)
     }
     ImGui::PopID();
 }
+
+void dibidab::behavior::TreeInspector::drawBuiltInNodeDebugInfo(const Tree::Node *node)
+{
+    if (const Tree::RepeaterNode *repeater = dynamic_cast<const Tree::RepeaterNode *>(node))
+    {
+        drawRepeaterDebugInfo(repeater);
+    }
+    else if (const ComponentDecoratorNode *decorator = dynamic_cast<const ComponentDecoratorNode *>(node))
+    {
+        drawComponentDecoratorDebugInfo(decorator);
+    }
+    else if (const ComponentObserverNode *observer = dynamic_cast<const ComponentObserverNode *>(node))
+    {
+        drawComponentObserverDebugInfo(observer);
+    }
+    else if (const WaitNode *wait = dynamic_cast<const WaitNode *>(node))
+    {
+        drawWaitDebugInfo(wait);
+    }
+}
+
+void dibidab::behavior::TreeInspector::drawRepeaterDebugInfo(const Tree::RepeaterNode *node)
+{
+#ifndef NDEBUG
+    ImGui::Text("%dx", node->timesRepeated);
+#endif
+}
+
+void dibidab::behavior::TreeInspector::drawComponentDecoratorDebugInfo(const ComponentDecoratorNode *node)
+{
+    for (int i = 0; i < node->toAddWhileEntered.size(); i++)
+    {
+        if (i > 0)
+        {
+            ImGui::TextDisabled(" | ");
+            ImGui::SameLine();
+        }
+        const ComponentDecoratorNode::EntityComponent &entityComponent = node->toAddWhileEntered[i];
+
+        ImGui::TextDisabled("Add ");
+        ImGui::SameLine();
+        ImGui::Text("%s", entityComponent.component->name);
+        ImGui::SameLine();
+        ImGui::TextDisabled(" to ");
+        ImGui::SameLine();
+
+        if (!entityComponent.engine->entities.valid(entityComponent.entity))
+        {
+            ImGui::Text("Invalid entity #%d", int(entityComponent.entity));
+            ImGui::SameLine();
+        }
+        else if (const char *entityName = entityComponent.engine->getName(entityComponent.entity))
+        {
+            ImGui::Text("#%d %s", int(entityComponent.entity), entityName);
+            ImGui::SameLine();
+        }
+        else
+        {
+            ImGui::Text("#%d", int(entityComponent.entity));
+            ImGui::SameLine();
+        }
+    }
+}
+
+void dibidab::behavior::TreeInspector::drawComponentObserverDebugInfo(const ComponentObserverNode *node)
+{
+    // TODO/WARNING: this debug info relies heavily on the implementation details.
+
+    for (int i = 0; i < node->observerHandles.size() / 2; i++)
+    {
+        if (i > 0)
+        {
+            ImGui::TextDisabled(" | ");
+            ImGui::SameLine();
+        }
+        const ComponentObserverNode::ObserverHandle &observerHandle = node->observerHandles[i * 2];
+        const entt::entity entity = observerHandle.handle.getEntity();
+
+        if (!observerHandle.engine->entities.valid(entity))
+        {
+            ImGui::Text("Invalid entity #%d", int(entity));
+            continue;
+        }
+        const bool bCurrentValue = node->conditions[i];
+
+        bool bTmpValue = bCurrentValue;
+        ImGui::Checkbox("", &bTmpValue);
+        ImGui::SameLine();
+
+        const bool bHasComponent = observerHandle.component->hasComponent(entity,
+            observerHandle.engine->entities);
+
+        if (const char *entityName = observerHandle.engine->getName(entity))
+        {
+            ImGui::Text("#%d %s ", int(entity), entityName);
+            ImGui::SameLine();
+        }
+        ImGui::TextDisabled(bCurrentValue == bHasComponent ? "has " : "excludes ");
+        ImGui::SameLine();
+        ImGui::Text("%s", observerHandle.component->name);
+        ImGui::SameLine();
+    }
+}
+
+void dibidab::behavior::TreeInspector::drawWaitDebugInfo(const WaitNode *node)
+{
+    const bool bUsingTime = node->seconds >= 0.0f && node->engine != nullptr;
+    if (bUsingTime)
+    {
+        ImGui::Text("%.2fs", node->seconds);
+    }
+    else
+    {
+        ImGui::TextDisabled("Until abort");
+    }
+    if (ImGui::IsItemHovered())
+    {
+        if (node->engine != nullptr && node->engine->entities.valid(node->waitingEntity))
+        {
+            if (const char *waitingEntityName = node->engine->getName(node->waitingEntity))
+            {
+                ImGui::SetTooltip("Entity: #%d %s", int(node->waitingEntity), waitingEntityName);
+            }
+            else
+            {
+                ImGui::SetTooltip("Entity: #%d", int(node->waitingEntity));
+            }
+        }
+    }
+#ifndef NDEBUG
+    if (bUsingTime && node->isEntered())
+    {
+        if (level::Room *room = dynamic_cast<level::Room *>(node->engine))
+        {
+            ImGui::SameLine();
+            const float timeElapsed = float(room->getLevel().getTime()) - node->timeStarted;
+            ImGui::ProgressBar(timeElapsed / node->seconds, ImVec2(100.0f, 0.0f),
+                std::string(std::to_string(int(timeElapsed)) + "." + std::to_string(int(fract(timeElapsed) * 10.0f))
+                    + "s").c_str());
+        }
+    }
+#endif
+}
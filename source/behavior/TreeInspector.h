@@ -3,6 +3,10 @@
 
 namespace dibidab::behavior
 {
+    struct ComponentDecoratorNode;
+    struct ComponentObserverNode;
+    struct WaitNode;
+
     class TreeInspector
     {
       public:
@@ -11,5 +15,19 @@ namespace dibidab::behavior
       private:
 
         void drawNode(Tree::Node *node, uint depth);
+
+        /**
+         * Draws the debug info of the nodes that come with dibidab.
+         * Kept out of the nodes themselves, so that the core library does not depend on ImGui.
+         */
+        void drawBuiltInNodeDebugInfo(const Tree::Node *node);
+
+        void drawRepeaterDebugInfo(const Tree::RepeaterNode *node);
+
+        void drawComponentDecoratorDebugInfo(const ComponentDecoratorNode *node);
+
+        void drawComponentObserverDebugInfo(const ComponentObserverNode *node);
+
+        void drawWaitDebugInfo(const WaitNode *node);
     };
 }
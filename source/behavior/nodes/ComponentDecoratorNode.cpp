@@ -1,7 +1,5 @@
 #include "ComponentDecoratorNode.h"
 
-#include <imgui.h>
-
 void dibidab::behavior::ComponentDecoratorNode::addWhileEntered(ecs::Engine *engine, entt::entity entity,
     const ComponentInfo *component)
 {
@@ -129,43 +127,6 @@ const char *dibidab::behavior::ComponentDecoratorNode::getName() const
     return "ComponentDecorator";
 }
 
-void dibidab::behavior::ComponentDecoratorNode::drawDebugInfo() const
-{
-    Node::drawDebugInfo();
-    for (int i = 0; i < toAddWhileEntered.size(); i++)
-    {
-        if (i > 0)
-        {
-            ImGui::TextDisabled(" | ");
-            ImGui::SameLine();
-        }
-        const EntityComponent &entityComponent = toAddWhileEntered[i];
-
-        ImGui::TextDisabled("Add ");
-        ImGui::SameLine();
-        ImGui::Text("%s", entityComponent.component->name);
-        ImGui::SameLine();
-        ImGui::TextDisabled(" to ");
-        ImGui::SameLine();
-
-        if (!entityComponent.engine->entities.valid(entityComponent.entity))
-        {
-            ImGui::Text("Invalid entity #%d", int(entityComponent.entity));
-            ImGui::SameLine();
-        }
-        else if (const char *entityName = entityComponent.engine->getName(entityComponent.entity))
-        {
-            ImGui::Text("#%d %s", int(entityComponent.entity), entityName);
-            ImGui::SameLine();
-        }
-        else
-        {
-            ImGui::Text("#%d", int(entityComponent.entity));
-            ImGui::SameLine();
-        }
-    }
-}
-
 void dibidab::behavior::ComponentDecoratorNode::onChildFinished(Node *child, Result result)
 {
     Node::onChildFinished(child, result);
@@ -51,8 +51,6 @@ namespace dibidab::behavior
 
         const char *getName() const override;
 
-        void drawDebugInfo() const override;
-
       protected:
         void onChildFinished(Node *child, Result result) override;
 
@@ -69,5 +67,7 @@ namespace dibidab::behavior
         std::vector<EntityComponent> toAddOnEnter;
         std::vector<EntityComponent> toRemoveOnFinish;
         std::vector<EntityComponent> toRemoveOnEnter;
+
+        friend class TreeInspector;
     };
 }
@@ -2,8 +2,6 @@
 
 #include "../../ecs/systems/TimeOutSystem.h"
 
-#include <imgui.h>
-
 dibidab::behavior::ComponentObserverNode::ComponentObserverNode()
 {
 }
@@ -79,47 +77,6 @@ const char *dibidab::behavior::ComponentObserverNode::getName() const
     return "ComponentObserver";
 }
 
-void dibidab::behavior::ComponentObserverNode::drawDebugInfo() const
-{
-    Node::drawDebugInfo();
-    // TODO/WARNING: this debug info relies heavily on the implementation details.
-
-    for (int i = 0; i < observerHandles.size() / 2; i++)
-    {
-        if (i > 0)
-        {
-            ImGui::TextDisabled(" | ");
-            ImGui::SameLine();
-        }
-        const ObserverHandle& observerHandle = observerHandles[i * 2];
-        const entt::entity entity = observerHandle.handle.getEntity();
-
-        if (!observerHandle.engine->entities.valid(entity))
-        {
-            ImGui::Text("Invalid entity #%d", int(entity));
-            continue;
-        }
-        const bool bCurrentValue = conditions[i];
-
-        bool bTmpValue = bCurrentValue;
-        ImGui::Checkbox("", &bTmpValue);
-        ImGui::SameLine();
-
-        const bool bHasComponent = observerHandle.component->hasComponent(entity,
-            observerHandle.engine->entities);
-
-        if (const char *entityName = observerHandle.engine->getName(entity))
-        {
-            ImGui::Text("#%d %s ", int(entity), entityName);
-            ImGui::SameLine();
-        }
-        ImGui::TextDisabled(bCurrentValue == bHasComponent ? "has " : "excludes ");
-        ImGui::SameLine();
-        ImGui::Text("%s", observerHandle.component->name);
-        ImGui::SameLine();
-    }
-}
-
 void dibidab::behavior::ComponentObserverNode::onChildFinished(Node *child, Result result)
 {
     Node::onChildFinished(child, result);
@@ -51,8 +51,6 @@ namespace dibidab::behavior
 
         const char *getName() const override;
 
-        void drawDebugInfo() const override;
-
         ~ComponentObserverNode() override;
 
       protected:
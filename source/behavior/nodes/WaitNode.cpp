@@ -3,8 +3,6 @@
 #include "../../level/Level.h"
 #include "../../ecs/systems/TimeOutSystem.h"
 
-#include <imgui.h>
-
 dibidab::behavior::WaitNode::WaitNode() :
     seconds(-1.0f),
     waitingEntity(entt::null),
@@ -72,44 +70,3 @@ const char *dibidab::behavior::WaitNode::getName() const
 {
     return "Wait";
 }
-
-void dibidab::behavior::WaitNode::drawDebugInfo() const
-{
-    Node::drawDebugInfo();
-    const bool bUsingTime = seconds >= 0.0f && engine != nullptr;
-    if (bUsingTime)
-    {
-        ImGui::Text("%.2fs", seconds);
-    }
-    else
-    {
-        ImGui::TextDisabled("Until abort");
-    }
-    if (ImGui::IsItemHovered())
-    {
-        if (engine != nullptr && engine->entities.valid(waitingEntity))
-        {
-            if (const char *waitingEntityName = engine->getName(waitingEntity))
-            {
-                ImGui::SetTooltip("Entity: #%d %s", int(waitingEntity), waitingEntityName);
-            }
-            else
-            {
-                ImGui::SetTooltip("Entity: #%d", int(waitingEntity));
-            }
-        }
-    }
-#ifndef NDEBUG
-    if (bUsingTime && isEntered())
-    {
-        if (level::Room *room = dynamic_cast<level::Room *>(engine))
-        {
-            ImGui::SameLine();
-            const float timeElapsed = float(room->getLevel().getTime()) - timeStarted;
-            ImGui::ProgressBar(timeElapsed / seconds, ImVec2(100.0f, 0.0f), std::string(std::to_string(int(timeElapsed))
-                + "." + std::to_string(int(fract(timeElapsed) * 10.0f)) + "s").c_str());
-        }
-    }
-#endif
-
-}
@@ -27,8 +27,6 @@ namespace dibidab::behavior
 
         const char *getName() const override;
 
-        void drawDebugInfo() const override;
-
       private:
         /**
          * If set to >= 0, will abort in n frames (where n could be 0, in case `seconds` <= deltaTime).
@@ -46,5 +44,7 @@ namespace dibidab::behavior
 #ifndef NDEBUG
         float timeStarted;
 #endif
+
+        friend class TreeInspector;
     };
 }
@@ -1,10 +1,10 @@
 #include "dibidab.h"
 
 #include "../ecs/Inspector.h"
+#include "../ecs/templates/LuaTemplate.h"
 #include "../rendering/ImGuiStyle.h"
 #include "../level/Level.h"
-
-#include "../generated/registry.struct_info.h"
+#include "../replay/InputReplay.h"
 
 #include <gu/game_utils.h>
 #include <gu/profiler.h>
@@ -13,23 +13,14 @@
 #include <files/file_utils.h>
 #include <files/FileWatcher.h>
 #include <code_editor/CodeEditor.h>
-#include <utils/startup_args.h>
 
 #include <mutex>
 
 namespace dibidab
 {
-    delegate<void(dibidab::level::Level *)> onLevelChange;
-
-    dibidab::EngineSettings settings;
-
-    std::map<std::string, std::string> startupArgs;
-
     std::mutex assetToReloadMutex;
     std::string assetToReload;
     FileWatcher assetWatcher;
-
-    level::Level *currentLevel = nullptr;
 }
 
 void showDeveloperOptionsMenuBar()
@@ -104,20 +95,8 @@ void showDeveloperOptionsMenuBar()
 
 void addDefaultAssetLoaders(const dibidab::Config &config)
 {
-    if (config.addAssetLoaders.bLua)
-    {
-        AssetManager::addAssetLoader<luau::Script>({ ".lua" }, [] (const std::string &path)
-        {
-            return new luau::Script(path);
-        });
-    }
-    if (config.addAssetLoaders.bJson)
-    {
-        AssetManager::addAssetLoader<json>({ ".json" }, [] (const std::string &path)
-        {
-            return new json(json::parse(fu::readString(path.c_str())));
-        });
-    }
+    dibidab::addCoreAssetLoaders(config.addAssetLoaders.bLua, config.addAssetLoaders.bJson);
+
     if (config.addAssetLoaders.bShaders)
     {
         AssetManager::addAssetLoader<std::string>({ ".frag", ".vert", ".glsl" }, [] (const std::string &path)
@@ -151,8 +130,7 @@ gu::Config dibidab::guConfigFromSettings()
 
 void dibidab::init(int argc, char **argv, Config &config)
 {
-    startupArgsToMap(argc, argv, dibidab::startupArgs);
-    registerStructs();
+    initCore(argc, argv);
 
     gu::bFullscreen = dibidab::settings.graphics.bFullscreen;
 
@@ -181,6 +159,11 @@ void dibidab::init(int argc, char **argv, Config &config)
     addDefaultAssetLoaders(config);
     AssetManager::loadDirectory("assets");
 
+    if (!config.recordInputPath.empty())
+    {
+        replay::startRecording(config.recordInputPath.c_str());
+    }
+
     // save window size in settings:
     static auto onResize = gu::onResize += []
     {
@@ -194,6 +177,11 @@ void dibidab::init(int argc, char **argv, Config &config)
 
     static auto beforeRender = gu::beforeRender += [&](double deltaTime)
     {
+        if (isCloseRequested())
+        {
+            gu::setShouldClose(true);
+        }
+
         if (level::Level *level = getLevel())
         {
             level->update(deltaTime);
@@ -202,6 +190,7 @@ void dibidab::init(int argc, char **argv, Config &config)
         if (KeyInput::justPressed(dibidab::settings.developerKeyInput.reloadAssets) && dibidab::settings.bShowDeveloperOptions)
         {
             AssetManager::loadDirectory("assets", true);
+            ecs::invalidateLuaTemplateDefinitions();
         }
 
         {
@@ -209,6 +198,7 @@ void dibidab::init(int argc, char **argv, Config &config)
             if (!assetToReload.empty())
             {
                 AssetManager::loadFile(assetToReload, "assets/", true);
+                ecs::invalidateLuaTemplateDefinitions();
             }
             assetToReload.clear();
             assetToReloadMutex.unlock();
@@ -240,26 +230,7 @@ void dibidab::init(int argc, char **argv, Config &config)
 void dibidab::run()
 {
     gu::run();
+    replay::stopRecording();
     setLevel(nullptr);
     dibidab::assetWatcher.stopWatching();
 }
-
-void dibidab::setLevel(dibidab::level::Level *level)
-{
-    if (currentLevel != nullptr && currentLevel->isUpdating())
-    {
-        throw gu_err("Cannot change level while updating level!");
-    }
-    delete currentLevel;
-    currentLevel = level;
-    if (currentLevel != nullptr)
-    {
-        currentLevel->initialize();
-    }
-    onLevelChange(level);
-}
-
-dibidab::level::Level *dibidab::getLevel()
-{
-    return currentLevel;
-}
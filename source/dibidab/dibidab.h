@@ -1,16 +1,12 @@
 #pragma once
-#include "dibidab_settings.dibidab.h"
+#include "dibidab_core.h"
 
 #include <gu/game_config.h>
-#include <utils/delegate.h>
+
+#include <string>
 
 namespace dibidab
 {
-    namespace level
-    {
-        class Level;
-    }
-
     struct Config
     {
         gu::Config guConfig;
@@ -23,21 +19,17 @@ namespace dibidab
             bool bTextures = true;
         }
         addAssetLoaders;
+
+        // If not empty, the delta times and input of every Level update are recorded to this path (see replay/InputReplay.h):
+        std::string recordInputPath;
     };
 
     gu::Config guConfigFromSettings();
 
+    /**
+     * Initializes the window, OpenGL and ImGui, and loads all assets.
+     */
     void init(int argc, char *argv[], Config &config);
 
     void run();
-
-    void setLevel(level::Level *level);
-
-    level::Level *getLevel();
-
-    extern delegate<void(level::Level *)> onLevelChange;
-
-    extern EngineSettings settings;
-
-    extern std::map<std::string, std::string> startupArgs;
 };
@@ -0,0 +1,101 @@
+#include "dibidab_core.h"
+
+#include "../level/Level.h"
+#include "../lua/luau.h"
+#include "../reflection/ComponentFunctions.h"
+#include "../threading/WorkerPool.h"
+#include "../ecs/components/Children.dibidab.h"
+#include "../ecs/components/DespawnAfter.dibidab.h"
+#include "../ecs/components/Input.dibidab.h"
+#include "../ecs/components/Inspecting.dibidab.h"
+#include "../ecs/components/LuaScripted.dibidab.h"
+#include "../ecs/components/Persistent.dibidab.h"
+#include "../ecs/components/Player.dibidab.h"
+
+#include "../generated/registry.struct_info.h"
+
+#include <assets/AssetManager.h>
+#include <files/file_utils.h>
+#include <utils/startup_args.h>
+
+#include <atomic>
+
+namespace dibidab
+{
+    delegate<void(dibidab::level::Level *)> onLevelChange;
+
+    dibidab::EngineSettings settings;
+
+    std::map<std::string, std::string> startupArgs;
+
+    level::Level *currentLevel = nullptr;
+
+    std::atomic<bool> bCloseRequested { false };
+}
+
+void dibidab::initCore(int argc, char **argv)
+{
+    threading::setMainThread();
+    startupArgsToMap(argc, argv, dibidab::startupArgs);
+    registerStructs();
+
+    registerComponentFunctions<
+        ecs::Parent,
+        ecs::Child,
+        ecs::DespawnAfter,
+        ecs::KeyListener,
+        ecs::GamepadListener,
+        ecs::Inspecting,
+        ecs::LuaScripted,
+        ecs::Persistent,
+        ecs::Player
+    >();
+}
+
+void dibidab::addCoreAssetLoaders(bool bLua, bool bJson)
+{
+    if (bLua)
+    {
+        AssetManager::addAssetLoader<luau::Script>({ ".lua" }, [] (const std::string &path)
+        {
+            return new luau::Script(path);
+        });
+    }
+    if (bJson)
+    {
+        AssetManager::addAssetLoader<json>({ ".json" }, [] (const std::string &path)
+        {
+            return new json(json::parse(fu::readString(path.c_str())));
+        });
+    }
+}
+
+void dibidab::setLevel(dibidab::level::Level *level)
+{
+    if (currentLevel != nullptr && currentLevel->isUpdating())
+    {
+        throw gu_err("Cannot change level while updating level!");
+    }
+    delete currentLevel;
+    currentLevel = level;
+    if (currentLevel != nullptr)
+    {
+        currentLevel->initialize();
+    }
+    onLevelChange(level);
+}
+
+dibidab::level::Level *dibidab::getLevel()
+{
+    return currentLevel;
+}
+
+void dibidab::requestClose()
+{
+    bCloseRequested = true;
+}
+
+bool dibidab::isCloseRequested()
+{
+    return bCloseRequested;
+}
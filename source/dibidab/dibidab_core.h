@@ -0,0 +1,47 @@
+#pragma once
+#include "dibidab_settings.dibidab.h"
+
+#include <utils/delegate.h>
+
+#include <map>
+#include <string>
+
+/**
+ * Everything in here is part of the `dibidab_core` library, which does not open a window or use OpenGL.
+ * Games with a window should use `dibidab.h`, headless programs (servers, benchmarks, CI) should use `headless.h`.
+ */
+namespace dibidab
+{
+    namespace level
+    {
+        class Level;
+    }
+
+    /**
+     * Parses the startup arguments and registers the reflection info of all structs, enums and components.
+     * Games should call `registerComponentFunctions()` (see `reflection/ComponentFunctions.h`) for their own components after this.
+     */
+    void initCore(int argc, char *argv[]);
+
+    /**
+     * Adds asset loaders for the asset types that do not need a graphics context.
+     */
+    void addCoreAssetLoaders(bool bLua, bool bJson);
+
+    void setLevel(level::Level *level);
+
+    level::Level *getLevel();
+
+    /**
+     * Asks the main loop (windowed or headless) to stop after the current update.
+     */
+    void requestClose();
+
+    bool isCloseRequested();
+
+    extern delegate<void(level::Level *)> onLevelChange;
+
+    extern EngineSettings settings;
+
+    extern std::map<std::string, std::string> startupArgs;
+};
@@ -0,0 +1,85 @@
+#include "headless.h"
+
+#include "../level/Level.h"
+#include "../profiling/TimingStats.h"
+#include "../replay/InputReplay.h"
+
+#include <assets/AssetManager.h>
+
+#include <chrono>
+#include <thread>
+
+namespace dibidab::headless
+{
+    delegate<void(double)> beforeUpdate;
+
+    Config headlessConfig;
+
+    long long nrOfUpdates = 0;
+}
+
+void dibidab::headless::init(int argc, char **argv, const Config &config)
+{
+    headlessConfig = config;
+    if (headlessConfig.updatesPerSecond <= 0)
+    {
+        throw gu_err("Headless updatesPerSecond should be more than 0!");
+    }
+
+    initCore(argc, argv);
+    addCoreAssetLoaders(config.addAssetLoaders.bLua, config.addAssetLoaders.bJson);
+    AssetManager::loadDirectory(config.assetsDirectory);
+
+    if (!config.replayPath.empty())
+    {
+        replay::startReplaying(config.replayPath.c_str());
+    }
+}
+
+void dibidab::headless::run()
+{
+    const bool bReplaying = replay::isReplaying();
+    double deltaTime = 1.0 / headlessConfig.updatesPerSecond;
+    const std::chrono::duration<double> stepDuration(deltaTime);
+
+    auto nextUpdate = std::chrono::steady_clock::now();
+
+    while (!isCloseRequested() && (headlessConfig.maxUpdates < 0 || nrOfUpdates < headlessConfig.maxUpdates))
+    {
+        if (bReplaying && !replay::nextReplayFrame(deltaTime))
+        {
+            break;
+        }
+        beforeUpdate(deltaTime);
+        if (level::Level *level = getLevel())
+        {
+            level->update(deltaTime);
+        }
+        nrOfUpdates++;
+
+        if (!headlessConfig.bRealTime || bReplaying)
+        {
+            continue;
+        }
+        nextUpdate += std::chrono::duration_cast<std::chrono::steady_clock::duration>(stepDuration);
+        const auto now = std::chrono::steady_clock::now();
+        if (nextUpdate < now - std::chrono::seconds(1))
+        {
+            // Fell behind too much, don't try to catch up:
+            nextUpdate = now;
+        }
+        std::this_thread::sleep_until(nextUpdate);
+    }
+    replay::stopReplaying();
+    setLevel(nullptr);
+
+    if (!headlessConfig.timingsOutputPath.empty())
+    {
+        profiling::dumpTimings(headlessConfig.timingsOutputPath.c_str());
+    }
+}
+
+long long dibidab::headless::getNrOfUpdates()
+{
+    return nrOfUpdates;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "dibidab_core.h"
+
+#include <string>
+
+/**
+ * Runs Levels without a window, OpenGL or ImGui. For dedicated servers, CI and benchmarks.
+ * Only link against the `dibidab_core` library when using this.
+ */
+namespace dibidab::headless
+{
+    struct Config
+    {
+        // The Level is updated with a fixed delta time of 1 / updatesPerSecond:
+        int updatesPerSecond = 60;
+
+        // If false, updates as fast as possible instead of waiting for the real time to pass (useful for benchmarks):
+        bool bRealTime = true;
+
+        // Stop after this many updates. Negative means: until `dibidab::requestClose()` is called.
+        long long maxUpdates = -1;
+
+        std::string assetsDirectory = "assets";
+
+        struct
+        {
+            bool bLua = true;
+            bool bJson = true;
+        }
+        addAssetLoaders;
+
+        // If not empty, the Level is updated with the delta times and input of this recording (see replay/InputReplay.h),
+        // as fast as possible, until the recording ends. `updatesPerSecond` and `bRealTime` are ignored:
+        std::string replayPath;
+
+        // If not empty, the timing statistics are written to this path (.json or .csv) when `run()` returns:
+        std::string timingsOutputPath;
+    };
+
+    void init(int argc, char *argv[], const Config &config);
+
+    /**
+     * Updates the current Level until the maximum number of updates is reached, the replay ended, or until a close is requested.
+     * Deletes the current Level before returning.
+     */
+    void run();
+
+    /**
+     * Called before every update of the Level, with the delta time.
+     */
+    extern delegate<void(double)> beforeUpdate;
+
+    long long getNrOfUpdates();
+}
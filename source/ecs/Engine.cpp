@@ -10,19 +10,88 @@
 
 #include "../reflection/ComponentInfo.h"
 #include "../reflection/StructInfo.h"
+#include "../threading/WorkerPool.h"
+#include "../profiling/TimingStats.h"
 
 #include <assets/AssetManager.h>
 #include <gu/profiler.h>
 #include <utils/string_utils.h>
 #include <utils/hashing.h>
 
+#include <algorithm>
+#include <chrono>
+#include <optional>
+
+namespace
+{
+    /**
+     * Key of the ComponentInfo (light userdata) in the metatable of a usertype, set on first use by `getComponentInfoFromLua()`.
+     * Usertypes that are no component get `NOT_A_COMPONENT` instead.
+     */
+    constexpr const char *COMPONENT_INFO_KEY = "__dibidabComponentInfo";
+    int NOT_A_COMPONENT = 0;
+
+    /**
+     * Returns the ComponentInfo of a usertype object, or nullptr if its type is no component.
+     * Only the first object of a type is looked up by struct name, after that the ComponentInfo is read from the metatable.
+     */
+    const dibidab::ComponentInfo *getComponentInfoFromLua(const sol::table &component)
+    {
+        lua_State *lua = component.lua_state();
+        component.push(lua);
+        if (!lua_getmetatable(lua, -1))
+        {
+            lua_pop(lua, 1);
+            throw gu_err("Given object is not a registered type");
+        }
+        lua_pushstring(lua, COMPONENT_INFO_KEY);
+        lua_rawget(lua, -2);
+        if (lua_islightuserdata(lua, -1))
+        {
+            void *cached = lua_touserdata(lua, -1);
+            lua_pop(lua, 3);
+            return cached == &NOT_A_COMPONENT ? nullptr : static_cast<const dibidab::ComponentInfo *>(cached);
+        }
+        lua_pop(lua, 3);
+
+        // Looked up while nothing is pushed, because this throws if the object has no type name:
+        const char *structId = component["__type"]["name"].get<const char *>();
+        const dibidab::StructInfo *structInfo = dibidab::findStructInfo(structId);
+        const dibidab::ComponentInfo *componentInfo = structInfo == nullptr ? nullptr : structInfo->componentInfo;
+
+        component.push(lua);
+        lua_getmetatable(lua, -1);
+        lua_pushstring(lua, COMPONENT_INFO_KEY);
+        lua_pushlightuserdata(lua, componentInfo == nullptr ? &NOT_A_COMPONENT : const_cast<dibidab::ComponentInfo *>(componentInfo));
+        lua_rawset(lua, -3);
+        lua_pop(lua, 2);
+        return componentInfo;
+    }
+}
+
 void dibidab::ecs::Engine::addSystem(System *sys, bool pushFront)
 {
-    assert(!bInitialized);
     if (pushFront)
-        systems.push_front(sys);
+    {
+        addSystem(sys, UpdatePhase::PreSpawn, true);
+    }
     else
-        systems.push_back(sys);
+    {
+        addSystem(sys, UpdatePhase::Simulation);
+    }
+}
+
+void dibidab::ecs::Engine::addSystem(System *sys, UpdatePhase phase, bool pushFront)
+{
+    assert(!bInitialized);
+    sys->phase = phase;
+
+    auto it = systems.begin();
+    while (it != systems.end() && ((*it)->phase < phase || (!pushFront && (*it)->phase == phase)))
+    {
+        ++it;
+    }
+    systems.insert(it, sys);
 }
 
 std::list<dibidab::ecs::System *> dibidab::ecs::Engine::getSystems()
@@ -30,6 +99,37 @@ std::list<dibidab::ecs::System *> dibidab::ecs::Engine::getSystems()
     return systems;
 }
 
+void dibidab::ecs::Engine::setUsesOwnLuaState(bool bOwnLuaState)
+{
+    assert(!bInitialized);
+    bUsesOwnLuaState = bOwnLuaState;
+}
+
+bool dibidab::ecs::Engine::usesOwnLuaState() const
+{
+    return bUsesOwnLuaState;
+}
+
+sol::state_view dibidab::ecs::Engine::getLuaState() const
+{
+    if (ownLuaState != nullptr)
+    {
+        return *ownLuaState;
+    }
+    return luau::getLuaState();
+}
+
+void dibidab::ecs::Engine::setSystemWorkerPool(threading::WorkerPool *pool)
+{
+    systemWorkerPool = pool;
+    invalidateSystemSchedule();
+}
+
+void dibidab::ecs::Engine::invalidateSystemSchedule()
+{
+    bSystemScheduleInvalidated = true;
+}
+
 dibidab::ecs::TimeOutSystem *dibidab::ecs::Engine::getTimeOuts()
 {
     return timeOutSystem;
@@ -54,10 +154,26 @@ dibidab::ecs::Template &dibidab::ecs::Engine::getTemplate(std::string name)
 
 dibidab::ecs::Template &dibidab::ecs::Engine::getTemplate(int templateHash)
 {
-    auto t = entityTemplates[templateHash];
-    if (!t)
-        throw gu_err("No EntityTemplate found for hash " + std::to_string(templateHash));
-    return *t;
+    std::lock_guard<std::recursive_mutex> lock(templatesMutex);
+
+    auto it = entityTemplates.find(templateHash);
+    if (it != entityTemplates.end() && it->second != nullptr)
+        return *it->second;
+
+    refreshLuaTemplateDefinitions();
+    if (luaTemplateDefinitions != nullptr)
+    {
+        auto definitionIt = luaTemplateDefinitions->definitions.find(templateHash);
+        if (definitionIt != luaTemplateDefinitions->definitions.end())
+        {
+            const LuaTemplateDefinitions::Definition &definition = definitionIt->second;
+            Template *t = entityTemplates[templateHash] = new LuaTemplate(definition.assetPath.c_str(), definition.name.c_str(), this);
+            t->engine = this;
+            t->templateHash = templateHash;
+            return *t;
+        }
+    }
+    throw gu_err("No EntityTemplate found for hash " + std::to_string(templateHash));
 }
 
 const std::vector<std::string> &dibidab::ecs::Engine::getTemplateNames() const
@@ -87,9 +203,12 @@ void dibidab::ecs::Engine::registerLuaEntityTemplate(const char *assetPath)
 
 void dibidab::ecs::Engine::addEntityTemplate(const std::string &name, Template *t)
 {
+    std::lock_guard<std::recursive_mutex> lock(templatesMutex);
+
     int hash = hashStringCrossPlatform(name);
 
-    bool replace = entityTemplates[hash] != nullptr;
+    bool replace = entityTemplates[hash] != nullptr
+        || (luaTemplateDefinitions != nullptr && luaTemplateDefinitions->definitions.count(hash) != 0);
 
     delete entityTemplates[hash];
     auto et = entityTemplates[hash] = t;
@@ -100,6 +219,37 @@ void dibidab::ecs::Engine::addEntityTemplate(const std::string &name, Template *
         entityTemplateNames.push_back(name);
 }
 
+void dibidab::ecs::Engine::refreshLuaTemplateDefinitions()
+{
+    if (luaTemplateDefinitions == nullptr)
+    {
+        // Not initialized yet.
+        return;
+    }
+    std::shared_ptr<const LuaTemplateDefinitions> latest = getLuaTemplateDefinitions(templateDirectoryPath);
+    if (latest == luaTemplateDefinitions)
+    {
+        return;
+    }
+    luaTemplateDefinitions = latest;
+
+    // Forget the names of removed scripts, unless their template was created already:
+    entityTemplateNames.erase(std::remove_if(entityTemplateNames.begin(), entityTemplateNames.end(), [&] (const std::string &name)
+    {
+        const int hash = hashStringCrossPlatform(name);
+        auto it = entityTemplates.find(hash);
+        return (it == entityTemplates.end() || it->second == nullptr) && latest->definitions.count(hash) == 0;
+    }), entityTemplateNames.end());
+
+    for (const std::string &name : latest->names)
+    {
+        if (std::find(entityTemplateNames.begin(), entityTemplateNames.end(), name) == entityTemplateNames.end())
+        {
+            entityTemplateNames.push_back(name);
+        }
+    }
+}
+
 dibidab::ecs::Engine::~Engine()
 {
     bDestructing = true;
@@ -131,9 +281,9 @@ void dibidab::ecs::Engine::initialize()
 {
     assert(!bInitialized);
 
-    addSystem(new KeyEventsSystem("Key Listeners"));
+    addSystem(new KeyEventsSystem("Key Listeners"), UpdatePhase::Post);
     timeOutSystem = new TimeOutSystem("Timeouts");
-    addSystem(timeOutSystem);
+    addSystem(timeOutSystem, UpdatePhase::Post);
 
     entities.on_construct<Child>().connect<&Engine::onChildCreation>(this);
     entities.on_destroy<Child>().connect<&Engine::onChildDeletion>(this);
@@ -144,23 +294,30 @@ void dibidab::ecs::Engine::initialize()
 
     initializeLuaEnvironment();
 
-    std::map<std::string, bool> registered;
-
-    for (auto &el : AssetManager::getAssetsForType<luau::Script>())
+    // The Lua templates are only created when used, so that creating a Room does not run every template script:
+    luaTemplateDefinitions = getLuaTemplateDefinitions(templateDirectoryPath);
+    for (const std::string &name : luaTemplateDefinitions->names)
     {
-        auto shortPath = el.second->shortPath.c_str();
-        if (registered[shortPath])
-            continue;
-
-        if (su::startsWith(el.first, templateDirectoryPath))
+        int hash = hashStringCrossPlatform(name);
+        auto it = entityTemplates.find(hash);
+        if (it == entityTemplates.end())
         {
-            registerLuaEntityTemplate(shortPath);
-            registered[shortPath] = true;
+            entityTemplateNames.push_back(name);
+            continue;
         }
+        // Lua templates replace templates with the same name that were registered earlier:
+        delete it->second;
+        entityTemplates.erase(it);
     }
 
     for (auto sys : systems)
+    {
+        sys->timings = &profiling::getTimings("system " + sys->name);
         sys->init(this);
+    }
+
+    buildSystemDependencies();
+    compileSystemSchedule();
 
     bInitialized = true;
 }
@@ -169,7 +326,13 @@ void dibidab::ecs::Engine::initializeLuaEnvironment()
 {
     // todo: functions might be called after Engine is destructed
 
-    luaEnvironment = sol::environment(luau::getLuaState(), sol::create, luau::getLuaState().globals());
+    if (bUsesOwnLuaState && ownLuaState == nullptr)
+    {
+        ownLuaState = std::make_unique<sol::state>();
+        luau::initializeLuaState(*ownLuaState);
+    }
+    sol::state_view lua = getLuaState();
+    luaEnvironment = sol::environment(lua, sol::create, lua.globals());
     auto &env = luaEnvironment;
 
     env["currentEngine"] = env;
@@ -235,6 +398,32 @@ void dibidab::ecs::Engine::initializeLuaEnvironment()
         else
             entityTemplate->createComponents(extendE, makePersistent);
     };
+    env["createMany"] = [&] (
+        const char *templateName, int count, const sol::optional<sol::table> &args, sol::optional<bool> persistent,
+        const sol::optional<sol::table> &perEntityArgs
+    )
+    {
+        Template &entityTemplate = getTemplate(templateName);
+        const bool makePersistent = persistent.value_or(false);
+
+        std::vector<entt::entity> created(std::max(0, count));
+        entities.reserve(entities.size() + created.size());
+        entities.create(created.begin(), created.end());
+
+        if (LuaTemplate *luaEntityTemplate = dynamic_cast<LuaTemplate *>(&entityTemplate))
+        {
+            luaEntityTemplate->createComponentsForManyWithLuaArguments(created, args, perEntityArgs, makePersistent);
+        }
+        else
+            entityTemplate.createComponentsForMany(created, makePersistent);
+
+        // A batch that failed is destroyed again:
+        created.erase(std::remove_if(created.begin(), created.end(), [&] (entt::entity e)
+        {
+            return !entities.valid(e);
+        }), created.end());
+        return sol::as_table(created);
+    };
 
     env["onEntityEvent"] = [&] (entt::entity entity, const char *eventName, const sol::function &listener)
     {
@@ -284,25 +473,265 @@ void dibidab::ecs::Engine::update(double deltaTime)
 
     bUpdating = true;
 
-    for (auto sys : getSystemsToUpdate())
+    if (isSystemScheduleOutdated())
     {
-        gu::profiler::Zone sysZone(sys->name);
+        compileSystemSchedule();
+    }
 
-        if (sys->updateFrequency == .0) sys->update(deltaTime, this);
-        else
+    if (systemWorkerPool != nullptr && systemWorkerPool->getNrOfThreads() > 0)
+    {
+        for (size_t batchI = 0; batchI < scheduledBatches.size(); batchI++)
         {
-            float customDeltaTime = 1.0f / sys->updateFrequency;
-            sys->updateAccumulator += deltaTime;
-            while (sys->updateAccumulator > customDeltaTime)
+            const std::vector<System *> &batch = scheduledBatches[batchI];
+            if (batch.size() == 1)
+            {
+                updateSystem(batch[0], deltaTime);
+                callAfterSystemUpdate(batch[0]);
+                continue;
+            }
+            std::optional<gu::profiler::Zone> batchZone;
+            if (threading::isMainThread())
+            {
+                batchZone.emplace(scheduledBatchNames[batchI]);
+            }
+
+            batchSystemMilliseconds.assign(batch.size(), 0.0);
+            threading::TaskGroup workerSystems(systemWorkerPool);
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                System *sys = batch[i];
+                if (!sys->requiresMainThread())
+                {
+                    workerSystems.run([this, sys, deltaTime, milliseconds = &batchSystemMilliseconds[i]]
+                    {
+                        updateSystem(sys, deltaTime, milliseconds);
+                    });
+                }
+            }
+            // Systems in one batch never conflict, so there can be at most one that requires the main thread:
+            for (System *sys : batch)
             {
-                sys->update(customDeltaTime, this);
-                sys->updateAccumulator -= customDeltaTime;
+                if (sys->requiresMainThread())
+                {
+                    updateSystem(sys, deltaTime);
+                }
+            }
+            workerSystems.wait();
+
+            // Timings are not added by the workers, so that they are added in update order:
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                if (!batch[i]->requiresMainThread() && batch[i]->timings != nullptr && profiling::areTimingsEnabled())
+                {
+                    batch[i]->timings->add(batchSystemMilliseconds[i]);
+                }
+            }
+            // In update order as well, so that the result is the same as without worker pool:
+            for (System *sys : batch)
+            {
+                callAfterSystemUpdate(sys);
             }
         }
     }
+    else
+    {
+        for (System *sys : scheduledSystems)
+        {
+            updateSystem(sys, deltaTime);
+            callAfterSystemUpdate(sys);
+        }
+    }
     bUpdating = false;
 }
 
+void dibidab::ecs::Engine::buildSystemDependencies()
+{
+    std::vector<System *> previousSystems;
+    for (System *sys : systems)
+    {
+        sys->dependencies.clear();
+        for (System *previous : previousSystems)
+        {
+            if (sys->conflictsWith(*previous))
+            {
+                sys->dependencies.push_back(previous);
+            }
+        }
+        previousSystems.push_back(sys);
+
+        for (const System::ComponentAccess &access : sys->componentsRead)
+        {
+            access.assurePool(entities);
+        }
+        for (const System::ComponentAccess &access : sys->componentsWritten)
+        {
+            access.assurePool(entities);
+        }
+    }
+}
+
+void dibidab::ecs::Engine::updateSystem(System *sys, double deltaTime, double *workerMilliseconds)
+{
+    if (!threading::isMainThread() && accessesSharedState(sys))
+    {
+        threading::runOnMainThread([&]
+        {
+            updateSystem(sys, deltaTime);
+        });
+        return;
+    }
+
+    // Profiler zones are not thread-safe:
+    std::optional<gu::profiler::Zone> sysZone;
+    if (threading::isMainThread())
+    {
+        sysZone.emplace(sys->name);
+    }
+
+    auto timedUpdate = [&] (double systemDeltaTime)
+    {
+        if (workerMilliseconds == nullptr)
+        {
+            profiling::ScopedTiming timing(sys->timings);
+            sys->update(systemDeltaTime, this);
+            return;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        sys->update(systemDeltaTime, this);
+        *workerMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    if (sys->updateFrequency == .0)
+    {
+        timedUpdate(deltaTime);
+    }
+    else
+    {
+        float customDeltaTime = 1.0f / sys->updateFrequency;
+        sys->updateAccumulator += deltaTime;
+        while (sys->updateAccumulator > customDeltaTime)
+        {
+            timedUpdate(customDeltaTime);
+            sys->updateAccumulator -= customDeltaTime;
+        }
+    }
+}
+
+bool dibidab::ecs::Engine::accessesSharedState(const System *sys) const
+{
+    // Systems with undeclared access (or Observer callbacks) might touch anything,
+    // but Lua is only shared if this Engine has no state of its own:
+    return !sys->bAccessDeclared || sys->bWritesObservedComponents || (sys->bUsesLua && ownLuaState == nullptr);
+}
+
+void dibidab::ecs::Engine::callAfterSystemUpdate(System *sys)
+{
+    if (sys->callsAfterUpdate.empty())
+    {
+        return;
+    }
+    std::vector<std::function<void()>> calls;
+    calls.swap(sys->callsAfterUpdate);
+
+    auto callAll = [&]
+    {
+        for (const std::function<void()> &call : calls)
+        {
+            call();
+        }
+    };
+    if (!threading::isMainThread())
+    {
+        threading::runOnMainThread(callAll);
+    }
+    else
+    {
+        callAll();
+    }
+}
+
+bool dibidab::ecs::Engine::isSystemScheduleOutdated() const
+{
+    if (bSystemScheduleInvalidated)
+    {
+        return true;
+    }
+    for (const System *sys : systems)
+    {
+        if (sys->bUpdatesEnabled != sys->bUpdatesEnabledWhenScheduled)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void dibidab::ecs::Engine::compileSystemSchedule()
+{
+    scheduledSystems.clear();
+    scheduledBatches.clear();
+    scheduledBatchNames.clear();
+
+    bool bObservedWritesChanged = false;
+    for (System *sys : systems)
+    {
+        sys->bUpdatesEnabledWhenScheduled = sys->bUpdatesEnabled;
+        sys->scheduleBatch = -1;
+
+        bool bWritesObservedComponents = false;
+        for (const System::ComponentAccess &access : sys->componentsWritten)
+        {
+            const ComponentInfo *info = findComponentInfo(access.name.c_str());
+            if (info != nullptr && observerPerComponent.find(info) != observerPerComponent.end())
+            {
+                bWritesObservedComponents = true;
+            }
+        }
+        bObservedWritesChanged |= sys->bWritesObservedComponents != bWritesObservedComponents;
+        sys->bWritesObservedComponents = bWritesObservedComponents;
+    }
+    if (bObservedWritesChanged)
+    {
+        buildSystemDependencies();
+    }
+    for (System *sys : getSystemsToUpdate())
+    {
+        scheduledSystems.push_back(sys);
+    }
+    bSystemScheduleInvalidated = false;
+
+    if (systemWorkerPool == nullptr)
+    {
+        return;
+    }
+    // Put each system in the first batch that comes after the batches of the systems it conflicts with:
+    for (System *sys : scheduledSystems)
+    {
+        int batch = 0;
+        for (const System *dependency : sys->dependencies)
+        {
+            if (dependency->scheduleBatch >= 0)
+            {
+                batch = std::max(batch, dependency->scheduleBatch + 1);
+            }
+        }
+        sys->scheduleBatch = batch;
+        if (batch >= int(scheduledBatches.size()))
+        {
+            scheduledBatches.emplace_back();
+        }
+        scheduledBatches[batch].push_back(sys);
+    }
+    for (const std::vector<System *> &batch : scheduledBatches)
+    {
+        std::string &batchName = scheduledBatchNames.emplace_back("parallel systems:");
+        for (const System *sys : batch)
+        {
+            batchName += " " + sys->name;
+        }
+    }
+}
+
 bool dibidab::ecs::Engine::isUpdating() const
 {
     return bUpdating;
@@ -409,16 +838,23 @@ dibidab::ecs::Observer &dibidab::ecs::Engine::getObserverForComponent(const Comp
     if (it == observerPerComponent.end())
     {
         it = observerPerComponent.emplace(&component, component.createObserver(this->entities)).first;
+        // Systems that write this component can no longer be updated on workers:
+        invalidateSystemSchedule();
     }
     return *it->second;
 }
 
+bool dibidab::ecs::Engine::shouldUpdateSystem(const System *) const
+{
+    return true;
+}
+
 std::list<dibidab::ecs::System *> dibidab::ecs::Engine::getSystemsToUpdate() const
 {
     std::list<System *> systemsToUpdate;
     for (System *sys : systems)
     {
-        if (sys->bUpdatesEnabled)
+        if (sys->bUpdatesEnabled && shouldUpdateSystem(sys))
         {
             systemsToUpdate.push_back(sys);
         }
@@ -433,13 +869,15 @@ void dibidab::ecs::Engine::setComponentFromLua(entt::entity entity, const sol::t
         throw gu_err("Given object is not a registered type");
     }
 
-    const char *structId = component["__type"]["name"].get<const char *>();
-
-    if (const dibidab::StructInfo *structInfo = dibidab::findStructInfo(structId))
+    if (const ComponentInfo *componentInfo = getComponentInfoFromLua(component))
     {
-        if (structInfo->componentInfo != nullptr)
+        if (componentInfo->emplaceFromLua != nullptr)
+        {
+            componentInfo->emplaceFromLua(component, entity, entities);
+        }
+        else
         {
-            structInfo->componentInfo->setFromLua(component, entity, entities);
+            componentInfo->setFromLua(component, entity, entities);
         }
     }
 }
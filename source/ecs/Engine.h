@@ -9,28 +9,80 @@
 
 #include <map>
 #include <list>
+#include <memory>
+#include <mutex>
 
 namespace dibidab
 {
     struct ComponentInfo;
+
+    namespace threading
+    {
+        class WorkerPool;
+    }
 }
 
 namespace dibidab::ecs
 {
     class System;
+    enum class UpdatePhase;
     class Template;
+    struct LuaTemplateDefinitions;
     class Observer;
     class TimeOutSystem;
 
     class Engine
     {
+        // Declared first, so that it is destroyed after all members that might still reference Lua objects:
+        std::unique_ptr<sol::state> ownLuaState;
+
       public:
         void initialize();
 
+        /**
+         * Must be called before `initialize()`.
+         * If true, this Engine will create its own Lua state, instead of using the process-wide `luau::getLuaState()`.
+         * This allows Lua to be used by multiple Engines at the same time, on different threads,
+         * and frees all Lua memory used by this Engine at once when it is destructed.
+         * NOTE: Lua objects (tables, functions) cannot be passed to Engines that use a different Lua state.
+         */
+        void setUsesOwnLuaState(bool bOwnLuaState);
+
+        bool usesOwnLuaState() const;
+
+        /**
+         * Returns the Lua state in which `luaEnvironment` lives.
+         */
+        sol::state_view getLuaState() const;
+
+        /**
+         * Adds the system to the Simulation phase.
+         * If `pushFront` is true the system is updated before all systems added so far (like before update phases existed),
+         * so it is added to the front of the first phase instead.
+         */
         void addSystem(System *sys, bool pushFront = false);
 
+        /**
+         * Adds the system to the given phase.
+         * If `pushFront` is true the system is updated before the systems already added to that phase, else after.
+         */
+        void addSystem(System *sys, UpdatePhase phase, bool pushFront = false);
+
         std::list<System *> getSystems();
 
+        /**
+         * If set, systems that do not conflict with each other (see `System::conflictsWith()`) are updated concurrently
+         * on the given pool. If nullptr (the default), all systems are updated one after another.
+         */
+        void setSystemWorkerPool(threading::WorkerPool *pool);
+
+        /**
+         * Makes the Engine recompile the order in which systems are updated, before the next update.
+         * This already happens automatically when `System::bUpdatesEnabled` changes.
+         * Call this when the outcome of `shouldUpdateSystem()` changes.
+         */
+        void invalidateSystemSchedule();
+
         template<class SystemType>
         SystemType *tryFindSystem()
         {
@@ -50,6 +102,12 @@ namespace dibidab::ecs
 
         Template &getTemplate(std::string name);
 
+        /**
+         * NOTE: not a pure lookup: the first time a Lua template is used it is created here (which runs its script),
+         * and the Lua template definitions are refreshed if they were invalidated (see `invalidateLuaTemplateDefinitions()`).
+         * Both change `entityTemplates`, which is guarded by a mutex, because Rooms can be updated on workers
+         * (see `Level::setRoomWorkerPool()`). Systems that are updated on workers should not spawn entities (see `System`).
+         */
         Template &getTemplate(int templateHash);
 
         const std::vector<std::string> &getTemplateNames() const;
@@ -99,6 +157,16 @@ namespace dibidab::ecs
 
         virtual void initializeLuaEnvironment();
 
+        /**
+         * Only called when the schedule is (re)compiled, see `invalidateSystemSchedule()`.
+         */
+        virtual bool shouldUpdateSystem(const System *) const;
+
+        /**
+         * Returns the enabled systems for which `shouldUpdateSystem()` returns true, in update order.
+         * NOTE: since systems are scheduled, this is only called when the schedule is (re)compiled, not every update.
+         * Overrides should call `invalidateSystemSchedule()` when their outcome changes.
+         */
         virtual std::list<System *> getSystemsToUpdate() const;
 
         template<class EntityTemplate>
@@ -117,7 +185,42 @@ namespace dibidab::ecs
         std::vector<std::string> entityTemplateNames;
         std::string templateDirectoryPath = "scripts/entities/";
 
+        // The Lua templates in `templateDirectoryPath`, created in `entityTemplates` by `getTemplate()` when first used:
+        std::shared_ptr<const LuaTemplateDefinitions> luaTemplateDefinitions;
+
       private:
+        void buildSystemDependencies();
+
+        /**
+         * Picks up new Lua template definitions, for example after a script was added, renamed or removed.
+         * Templates that were already created are kept, because entities can still reference them.
+         */
+        void refreshLuaTemplateDefinitions();
+
+        // Guards `entityTemplates`, `entityTemplateNames` and `luaTemplateDefinitions`. Recursive, because creating a Lua template runs its script:
+        std::recursive_mutex templatesMutex;
+
+        /**
+         * Systems that can access state shared between Engines (like Lua and the AssetManager) are always updated on
+         * the main thread, also when this Engine is updated by a worker (see `Level::setRoomWorkerPool()`).
+         * Systems that only use Lua are not if this Engine uses its own Lua state.
+         *
+         * @param workerMilliseconds If not nullptr, the time spent is added to it instead of to the system's timings.
+         */
+        void updateSystem(System *, double deltaTime, double *workerMilliseconds = nullptr);
+
+        bool accessesSharedState(const System *) const;
+
+        /**
+         * Calls the functions the system added with `System::callAfterUpdate()`.
+         * They can touch anything, so like systems with undeclared access they are called on the main thread.
+         */
+        void callAfterSystemUpdate(System *);
+
+        bool isSystemScheduleOutdated() const;
+
+        void compileSystemSchedule();
+
         void onChildCreation(entt::registry &, entt::entity);
 
         void onChildDeletion(entt::registry &, entt::entity);
@@ -131,9 +234,20 @@ namespace dibidab::ecs
         void setComponentFromLua(entt::entity entity, const sol::table &component);
 
         bool bInitialized = false;
+        bool bUsesOwnLuaState = false;
         bool bUpdating = false;
         bool bDestructing = false;
         TimeOutSystem *timeOutSystem;
+        threading::WorkerPool *systemWorkerPool = nullptr;
+
+        bool bSystemScheduleInvalidated = true;
+        // All systems to update, in update order:
+        std::vector<System *> scheduledSystems;
+        // Same systems, grouped in batches of systems that can be updated concurrently. Only used with a worker pool:
+        std::vector<std::vector<System *>> scheduledBatches;
+        // Profiler zone name per batch, and the time spent by each system of the batch that is being updated:
+        std::vector<std::string> scheduledBatchNames;
+        std::vector<double> batchSystemMilliseconds;
         std::map<const ComponentInfo *, Observer *> observerPerComponent;
     };
 }
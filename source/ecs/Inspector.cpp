@@ -133,6 +133,7 @@ void dibidab::ecs::Inspector::editTemplateAsset(const loaded_asset &templateAsse
     {
         fu::writeBinary(templateAsset.fullPath.c_str(), tab.code.c_str(), tab.code.length());
         AssetManager::loadFile(templateAsset.fullPath, "assets/");
+        invalidateLuaTemplateDefinitions();
     };
     codeTab.revert = [&templateAsset] (CodeEditor::Tab &tab)
     {
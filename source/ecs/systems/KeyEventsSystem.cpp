@@ -2,9 +2,13 @@
 
 #include "../components/Input.dibidab.h"
 #include "../Engine.h"
+#include "../../replay/InputReplay.h"
 
 void dibidab::ecs::KeyEventsSystem::init(Engine *engine)
 {
+    // The event listeners can touch anything, but the events are emitted after the update:
+    readsComponents<KeyListener, GamepadListener>();
+
     engine->luaEnvironment["listenToKey"] = [engine] (entt::entity e, KeyInput::Key *keyPtr, const std::string &name)
     {
         engine->entities.get_or_assign<KeyListener>(e).keys[name] = keyPtr;
@@ -17,7 +21,7 @@ void dibidab::ecs::KeyEventsSystem::init(Engine *engine)
     };
     engine->luaEnvironment["getGamepadAxis"] = [] (uint gamepad, const GamepadInput::Axis &axis)
     {
-        return GamepadInput::getAxis(gamepad, axis.glfwValue);
+        return replay::getGamepadAxis(gamepad, axis.glfwValue);
     };
 }
 
@@ -25,29 +29,36 @@ void dibidab::ecs::KeyEventsSystem::update(double deltaTime, Engine *engine)
 {
     engine->entities.view<KeyListener>().each([&] (auto e, const KeyListener &listener)
     {
-        KeyListener cpy = listener;
-
-        for (auto &[name, keyPtr] : cpy.keys)
+        for (auto &[name, keyPtr] : listener.keys)
         {
-            if (KeyInput::justPressed(keyPtr->glfwValue) && engine->entities.valid(e))
-                engine->emitEntityEvent(e, keyPtr, (name + "_pressed").c_str());  // todo: queue events
-            else if (KeyInput::justReleased(keyPtr->glfwValue) && engine->entities.valid(e))
-                engine->emitEntityEvent(e, keyPtr, (name + "_released").c_str());
+            if (replay::keyJustPressed(keyPtr->glfwValue))
+                emitAfterUpdate(engine, e, keyPtr, name + "_pressed");
+            else if (replay::keyJustReleased(keyPtr->glfwValue))
+                emitAfterUpdate(engine, e, keyPtr, name + "_released");
         }
     });
 
-    engine->entities.view<GamepadListener>().each([&] (auto e, GamepadListener &listener)
+    engine->entities.view<GamepadListener>().each([&] (auto e, const GamepadListener &listener)
     {
-        GamepadListener cpy = listener;
-
-        for (auto &[name, keyPtr] : cpy.buttons)
+        for (auto &[name, keyPtr] : listener.buttons)
         {
-            if (GamepadInput::justPressed(cpy.gamepad, keyPtr->glfwValue) && engine->entities.valid(e))
-                engine->emitEntityEvent(e, keyPtr, (name + "_pressed").c_str());  // todo: queue events
-            else if (GamepadInput::justReleased(cpy.gamepad, keyPtr->glfwValue) && engine->entities.valid(e))
-                engine->emitEntityEvent(e, keyPtr, (name + "_released").c_str());
+            if (replay::buttonJustPressed(listener.gamepad, keyPtr->glfwValue))
+                emitAfterUpdate(engine, e, keyPtr, name + "_pressed");
+            else if (replay::buttonJustReleased(listener.gamepad, keyPtr->glfwValue))
+                emitAfterUpdate(engine, e, keyPtr, name + "_released");
         }
     });
+}
 
-    // todo: dequeue
+template<typename Input>
+void dibidab::ecs::KeyEventsSystem::emitAfterUpdate(Engine *engine, entt::entity e, Input *input, std::string eventName)
+{
+    callAfterUpdate([engine, e, input, eventName = std::move(eventName)]
+    {
+        // A previous listener might have destroyed the entity:
+        if (engine->entities.valid(e))
+        {
+            engine->emitEntityEvent(e, input, eventName.c_str());
+        }
+    });
 }
@@ -1,6 +1,8 @@
 #pragma once
 #include "System.h"
 
+#include <string>
+
 namespace dibidab::ecs
 {
     class KeyEventsSystem : public System
@@ -12,5 +14,11 @@ namespace dibidab::ecs
 
         void update(double deltaTime, Engine *engine) override;
 
+      private:
+        /**
+         * Events are emitted after the update, because their listeners can touch anything.
+         */
+        template<typename Input>
+        void emitAfterUpdate(Engine *engine, entt::entity, Input *, std::string eventName);
     };
 }
@@ -4,3 +4,49 @@ dibidab::ecs::System::System(const std::string &name) :
     name(name)
 {
 }
+
+bool dibidab::ecs::System::conflictsWith(const System &other) const
+{
+    if (!bAccessDeclared || !other.bAccessDeclared || bWritesObservedComponents || other.bWritesObservedComponents)
+    {
+        return true;
+    }
+    if (bUsesLua && other.bUsesLua)
+    {
+        return true;
+    }
+    return overlaps(componentsWritten, other.componentsWritten)
+        || overlaps(componentsWritten, other.componentsRead)
+        || overlaps(componentsRead, other.componentsWritten);
+}
+
+bool dibidab::ecs::System::requiresMainThread() const
+{
+    return !bAccessDeclared || bUsesLua || bWritesObservedComponents;
+}
+
+void dibidab::ecs::System::usesLua()
+{
+    bAccessDeclared = true;
+    bUsesLua = true;
+}
+
+void dibidab::ecs::System::callAfterUpdate(std::function<void()> function)
+{
+    callsAfterUpdate.push_back(std::move(function));
+}
+
+bool dibidab::ecs::System::overlaps(const std::vector<ComponentAccess> &a, const std::vector<ComponentAccess> &b)
+{
+    for (const ComponentAccess &accessA : a)
+    {
+        for (const ComponentAccess &accessB : b)
+        {
+            if (accessA.type == accessB.type)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -1,14 +1,46 @@
 #pragma once
+#include <utils/type_name.h>
+
+#include <entt/entity/registry.hpp>
+
+#include <functional>
 #include <string>
+#include <vector>
+#include <typeindex>
+
+namespace dibidab::profiling
+{
+    class RollingTimings;
+}
 
 namespace dibidab::ecs
 {
     class Engine;
 
+    /**
+     * Systems are updated phase by phase, in the order declared here.
+     * Within a phase, systems are updated in the order in which they were added to the Engine.
+     */
+    enum class UpdatePhase
+    {
+        PreSpawn,   // (De)spawning of entities, so that new entities get updated before being rendered.
+        Scripts,    // Lua update functions, that might spawn entities as well.
+        Simulation, // Game systems (default).
+        Post        // Systems that react on the results of the simulation, like input events and timeouts.
+    };
+
     /**
      * Base class for all entity systems.
      *
      * An entity system should be used for updating components of entities.
+     *
+     * By default a system is assumed to touch anything, and it will be updated on the main thread, on its own.
+     * A system that declares which components it reads and writes (see `readsComponents()` and `writesComponents()`)
+     * can be updated on a worker thread, concurrently with other systems that do not conflict with it.
+     * Such a system should ONLY access the components it declared, and should NOT create or destroy entities.
+     * Anything else (like spawning entities, or calling callbacks that can touch anything) can be done with `callAfterUpdate()`.
+     * A system that writes a component that has an Observer (see `Engine::getObserverForComponent()`) is updated
+     * like a system without declared access, because the callbacks of the Observer can touch anything.
      */
     class System
     {
@@ -18,16 +50,106 @@ namespace dibidab::ecs
         const std::string name;
         bool bUpdatesEnabled = true;
 
+        /**
+         * If false, this system is skipped when its Room is simulated at a reduced rate in the background.
+         * See `Level::roomSimulationPolicy`.
+         */
+        bool bUpdatesInBackground = true;
+
+        /**
+         * Returns true if this system and `other` cannot be updated at the same time.
+         */
+        bool conflictsWith(const System &other) const;
+
+        /**
+         * Returns true if this system must be updated on the thread that calls `Engine::update()`.
+         * See `Engine::updateSystem()` for when it is updated on the main thread instead.
+         */
+        bool requiresMainThread() const;
+
       protected:
         friend Engine;
 
         int updateFrequency = 0; // update this system n times per second. if n = 0 then update(deltaTime) is called, else update(1/n)
         float updateAccumulator = 0;
 
+        template<class... Components>
+        void readsComponents()
+        {
+            (declareComponentAccess<Components>(componentsRead), ...);
+        }
+
+        template<class... Components>
+        void writesComponents()
+        {
+            (declareComponentAccess<Components>(componentsWritten), ...);
+        }
+
+        /**
+         * Marks this system as one that calls Lua. It will then be updated on the main thread, but not at the same
+         * time as other systems that use Lua.
+         * Components touched by the called Lua functions should be declared as well,
+         * including the components for which the Lua functions create Observers (as written).
+         */
+        void usesLua();
+
+        /**
+         * Calls the function after this system is updated, while no other system is being updated, on the thread that
+         * updates systems with undeclared access (see `Engine::updateSystem()`). Functions are called in the order they were added.
+         * Allows a system that is updated on a worker to do things that can touch anything, like calling callbacks.
+         */
+        void callAfterUpdate(std::function<void()> function);
+
         virtual void init(Engine *) {}
 
         virtual void update(double deltaTime, Engine *) = 0;
 
         virtual ~System() = default;
+
+      private:
+        struct ComponentAccess
+        {
+            std::type_index type;
+            // Used to find the ComponentInfo, for components that are registered:
+            std::string name;
+            // Called before updating in parallel, so that EnTT does not lazily create the pool from multiple threads:
+            void (*assurePool)(entt::registry &);
+        };
+
+        template<class Component>
+        void declareComponentAccess(std::vector<ComponentAccess> &accesses)
+        {
+            bAccessDeclared = true;
+            accesses.push_back({
+                std::type_index(typeid(Component)),
+                typename_utils::getTypeName<Component>(),
+                [] (entt::registry &registry)
+                {
+                    registry.reserve<Component>(0);
+                }
+            });
+        }
+
+        static bool overlaps(const std::vector<ComponentAccess> &a, const std::vector<ComponentAccess> &b);
+
+        // Only accessed by the thread that updates this system, and by the Engine after the update:
+        std::vector<std::function<void()>> callsAfterUpdate;
+
+        bool bAccessDeclared = false;
+        bool bUsesLua = false;
+        // Set by the Engine when the schedule is compiled:
+        bool bWritesObservedComponents = false;
+        std::vector<ComponentAccess> componentsRead;
+        std::vector<ComponentAccess> componentsWritten;
+
+        UpdatePhase phase = UpdatePhase::Simulation;
+
+        // Shared by all systems with the same name, in all Engines. Set by the Engine during initialization.
+        profiling::RollingTimings *timings = nullptr;
+
+        // Systems earlier in the update order that conflict with this one. Set by the Engine during initialization.
+        std::vector<System *> dependencies;
+        int scheduleBatch = 0;
+        bool bUpdatesEnabledWhenScheduled = true;
     };
 }
@@ -25,11 +25,16 @@ void dibidab::ecs::TimeOutSystem::init(Engine *inEngine)
 {
     System::init(inEngine);
     engine = inEngine;
+    // The callbacks can touch anything, but they are called after the update:
+    writesComponents<TimeOuts>();
 }
 
 void dibidab::ecs::TimeOutSystem::update(double deltaTimeDouble, Engine *)
 {
-    nextUpdate();
+    callAfterUpdate([callbacks = nextUpdate] () mutable
+    {
+        callbacks();
+    });
     nextUpdate = delegate<void()>();
 
     /*
@@ -67,11 +72,18 @@ void dibidab::ecs::TimeOutSystem::update(double deltaTimeDouble, Engine *)
             engine->entities.remove<TimeOuts>(e);
         }
     });
-    for (auto &[entity, delegate] : toCall)
+    if (toCall.empty())
+    {
+        return;
+    }
+    callAfterUpdate([this, toCall = std::move(toCall)] () mutable
     {
-        if (engine->entities.valid(entity))
+        for (auto &[entity, delegate] : toCall)
         {
-            delegate();
+            if (engine->entities.valid(entity))
+            {
+                delegate();
+            }
         }
-    }
+    });
 }
@@ -20,6 +20,9 @@ namespace dibidab::ecs
          */
         delegate_method unsafeCallAfter(float seconds, entt::entity waitingEntity, const std::function<void()> &callback);
 
+        /**
+         * Called (once) during the next update, before the timeouts that have passed.
+         */
         delegate<void()> nextUpdate;
 
       protected:
@@ -1,9 +1,135 @@
 #include "LuaTemplate.h"
 
 #include "../components/LuaScripted.dibidab.h"
+#include "../../reflection/ComponentInfo.h"
 
 #include <assets/AssetManager.h>
 #include <utils/string_utils.h>
+#include <utils/hashing.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+    // Incremented by `invalidateLuaTemplateDefinitions()`:
+    std::atomic<int> luaTemplateDefinitionsGeneration { 0 };
+
+    /**
+     * Appends a binary description of `value` to `key`, so that tables with the same contents give the same key.
+     * Returns false for values that cannot be described, like functions, userdata and deeply nested tables.
+     */
+    bool appendPrefabKey(const sol::object &value, std::string &key, int depth = 0)
+    {
+        switch (value.get_type())
+        {
+            case sol::type::lua_nil:
+                key += 'n';
+                return true;
+            case sol::type::boolean:
+                key += value.as<bool>() ? 'T' : 'F';
+                return true;
+            case sol::type::number:
+            {
+                const double number = value.as<double>();
+                key += 'd';
+                key.append(reinterpret_cast<const char *>(&number), sizeof(number));
+                return true;
+            }
+            case sol::type::string:
+            {
+                const std::string_view string = value.as<std::string_view>();
+                const uint32_t size = uint32_t(string.size());
+                key += 's';
+                key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+                key.append(string);
+                return true;
+            }
+            case sol::type::table:
+            {
+                if (depth >= 16)
+                {
+                    return false;
+                }
+                // Iteration order depends on how the table was built, so the entries are sorted by key:
+                std::vector<std::pair<std::string, std::string>> entries;
+                for (const auto &[entryKey, entryValue] : value.as<sol::table>())
+                {
+                    auto &[keyString, valueString] = entries.emplace_back();
+                    if (!appendPrefabKey(entryKey, keyString, depth + 1) || !appendPrefabKey(entryValue, valueString, depth + 1))
+                    {
+                        return false;
+                    }
+                }
+                std::sort(entries.begin(), entries.end());
+                key += 't';
+                for (const auto &[keyString, valueString] : entries)
+                {
+                    key += keyString;
+                    key += valueString;
+                }
+                key += 'e';
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+}
+
+std::shared_ptr<const dibidab::ecs::LuaTemplateDefinitions> dibidab::ecs::getLuaTemplateDefinitions(const std::string &directoryPath)
+{
+    struct CacheEntry
+    {
+        size_t nrOfScripts = 0;
+        int generation = 0;
+        std::shared_ptr<const LuaTemplateDefinitions> definitions;
+    };
+    static std::mutex cacheMutex;
+    static std::map<std::string, CacheEntry> cache;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const auto &scripts = AssetManager::getAssetsForType<luau::Script>();
+    const int generation = luaTemplateDefinitionsGeneration;
+    CacheEntry &entry = cache[directoryPath];
+    if (entry.definitions != nullptr && entry.nrOfScripts == scripts.size() && entry.generation == generation)
+    {
+        return entry.definitions;
+    }
+    auto definitions = std::make_shared<LuaTemplateDefinitions>();
+    for (auto &el : scripts)
+    {
+        if (!su::startsWith(el.first, directoryPath))
+        {
+            continue;
+        }
+        const std::string &assetPath = el.second->shortPath;
+        const std::string name = su::split(assetPath, "/").back();
+        if (su::startsWith(name, "_"))
+        {
+            continue;
+        }
+        // Like `Engine::addEntityTemplate()`, a later script with the same name replaces the earlier one:
+        const bool bNewName = definitions->definitions.insert_or_assign(
+            hashStringCrossPlatform(name), LuaTemplateDefinitions::Definition { name, assetPath }
+        ).second;
+        if (bNewName)
+        {
+            definitions->names.push_back(name);
+        }
+    }
+    entry.nrOfScripts = scripts.size();
+    entry.generation = generation;
+    entry.definitions = definitions;
+    return definitions;
+}
+
+void dibidab::ecs::invalidateLuaTemplateDefinitions()
+{
+    luaTemplateDefinitionsGeneration++;
+}
 
 dibidab::ecs::LuaTemplate::LuaTemplate(const char *assetName, const char *name, Engine *engine_) :
     script(assetName),
@@ -14,7 +140,7 @@ dibidab::ecs::LuaTemplate::LuaTemplate(const char *assetName, const char *name,
     luaEnvironment["TEMPLATE_NAME"] = name;
     luaEnvironment["TEMPLATE_PTR"] = this;
 
-    defaultArgs = sol::table::create(luaEnvironment.lua_state());
+    setDefaultArgs(sol::table::create(luaEnvironment.lua_state()));
 
     int
         TEMPLATE = luaEnvironment["TEMPLATE"] = 1 << 0,
@@ -38,12 +164,16 @@ dibidab::ecs::LuaTemplate::LuaTemplate(const char *assetName, const char *name,
 
     luaEnvironment["defaultArgs"] = [&] (const sol::table &table)
     {
-        defaultArgs = table;
+        setDefaultArgs(table);
     };
     luaEnvironment["description"] = [&] (const char *d)
     {
         description = d;
     };
+    luaEnvironment["enablePrefabBaking"] = [&] ()
+    {
+        bPrefabBaking = true;
+    };
     luaEnvironment["setUpdateFunction"] =
         [&] (entt::entity entity, float updateFrequency, const sol::safe_function &func, sol::optional<bool> randomAcummulationDelay)
     {
@@ -70,17 +200,31 @@ dibidab::ecs::LuaTemplate::LuaTemplate(const char *assetName, const char *name,
 
 void dibidab::ecs::LuaTemplate::runScript()
 {
+    // The script has to enable it again, and prefabs of the old script are outdated:
+    bPrefabBaking = false;
+    for (auto &[key, prefab] : prefabs)
+    {
+        if (prefab.prototype != entt::null)
+        {
+            prefabPrototypes.destroy(prefab.prototype);
+        }
+    }
+    prefabs.clear();
     try
     {
-        // todo: use same lua_state as 'env' is in
-
-        sol::protected_function_result result = luau::getLuaState().safe_script(script->getByteCode().as_string_view(), luaEnvironment);
+        sol::state_view lua(luaEnvironment.lua_state());
+        sol::protected_function_result result = lua.safe_script(script->getByteCode().as_string_view(), luaEnvironment);
         if (!result.valid())
             throw gu_err(result.get<sol::error>().what());
 
         luaCreateComponents = luaEnvironment["create"];
         if (!luaCreateComponents.valid())
             throw gu_err("No create() function found!");
+
+        // Optional, see `createComponentsForManyWithLuaArguments()`:
+        luaCreateBatch = luaEnvironment["createBatch"];
+
+        jsonFromLuaTable(defaultArgs, defaultArgsJson);
     }
     catch (std::exception &e)
     {
@@ -105,61 +249,296 @@ void dibidab::ecs::LuaTemplate::createComponentsWithLuaArguments(entt::entity e,
         runScript();
     }
 
+    // Prefabs describe the complete entity, so they are only used for entities without components:
+    const bool bUsePrefab = bPrefabBaking && engine->entities.orphan(e);
+    const bool bDefaultArgs = !arguments.has_value();
     try
     {
-        if (arguments.has_value() && defaultArgs.valid())
+        prepareEntity(e, arguments, bPersistent);
+
+        Prefab *prefab = nullptr;
+        if (bUsePrefab)
         {
-            for (auto &[key, defaultVal] : defaultArgs)
+            std::string prefabKey = bPersistent ? "p" : "t";
+            const bool bHasKey = bDefaultArgs || !arguments.value().valid() || appendPrefabKey(arguments.value(), prefabKey);
+            auto prefabIt = bHasKey ? prefabs.find(prefabKey) : prefabs.end();
+            if (prefabIt != prefabs.end() && prefabIt->second.bUsable)
             {
-                if (!arguments.value()[key].valid())
-                {
-                    arguments.value()[key] = defaultVal;
-                }
+                stampPrefab(prefabIt->second, e);
+                return;
+            }
+            if (bHasKey && prefabIt == prefabs.end() && prefabs.size() < size_t(MAX_PREFABS))
+            {
+                // Not usable until create() succeeded:
+                prefab = &prefabs[prefabKey];
+                prefab->bUsable = false;
             }
-        } else arguments = defaultArgs;
+        }
+        const auto nrOfEntitiesBefore = engine->entities.alive();
 
-        LuaScripted& luaScripted = engine->entities.get_or_assign<LuaScripted>(e);
-        if (luaScripted.usedTemplate == nullptr)
+        const sol::protected_function_result result = luaCreateComponents(
+            e,
+            arguments,
+            bPersistent
+        );
+        if (!result.valid())
         {
-            luaScripted.usedTemplate = this;
+            throw gu_err(result.get<sol::error>().what());
         }
+        // NOTE!!: ALL REFERENCES TO COMPONENTS MIGHT BE BROKEN AFTER CALLING luaCreateComponents. (EnTT might resize containers)
 
-        if (bPersistent)
+        if (prefab != nullptr)
         {
-            std::string previousAppliedTemplate;
-            if (const Persistent *pOld = engine->entities.try_get<Persistent>(e))
+            if (engine->entities.alive() != nrOfEntitiesBefore)
             {
-                previousAppliedTemplate = pOld->applyTemplateOnLoad;
+                std::cerr << "Cannot bake prefab of template '" << name << "', create() created or destroyed other entities" << std::endl;
+                prefab->bUsable = false;
             }
+            else
+            {
+                prefab->bUsable = bakePrefab(e, *prefab);
+            }
+        }
+    }
+    catch (std::exception &exception)
+    {
+        std::cerr << "Error while creating entity using " << script.getLoadedAsset()->fullPath << ":" << std::endl;
+        std::cerr << exception.what() << std::endl;
+    }
+}
 
-            auto &p = engine->entities.assign_or_replace<Persistent>(e, persistency);
-            if (!previousAppliedTemplate.empty())
+void dibidab::ecs::LuaTemplate::prepareEntity(entt::entity e, sol::optional<sol::table> &arguments, bool bPersistent)
+{
+    if (arguments.has_value() && defaultArgs.valid())
+    {
+        sol::table &args = arguments.value();
+        // Copied instead of falling back through a metatable, so that `pairs()` in `create()` sees the defaults as well:
+        for (auto &[key, defaultVal] : defaultArgs)
+        {
+            if (!args[key].valid())
             {
-                p.applyTemplateOnLoad = previousAppliedTemplate;
+                args[key] = defaultVal;
             }
-            p.entityHint = e;
-            if (bPersistentArgs && arguments.has_value() && arguments.value().valid())
-                jsonFromLuaTable(arguments.value(), p.data);
+        }
+    } else arguments = defaultArgs;
+
+    LuaScripted& luaScripted = engine->entities.get_or_assign<LuaScripted>(e);
+    if (luaScripted.usedTemplate == nullptr)
+    {
+        luaScripted.usedTemplate = this;
+    }
 
-            assert(p.data.is_object());
+    if (bPersistent)
+    {
+        std::string previousAppliedTemplate;
+        if (const Persistent *pOld = engine->entities.try_get<Persistent>(e))
+        {
+            previousAppliedTemplate = pOld->applyTemplateOnLoad;
         }
 
-        const sol::protected_function_result result = luaCreateComponents(
-            e,
-            arguments,
-            bPersistent
-        );
+        auto &p = engine->entities.assign_or_replace<Persistent>(e, persistency);
+        if (!previousAppliedTemplate.empty())
+        {
+            p.applyTemplateOnLoad = previousAppliedTemplate;
+        }
+        p.entityHint = e;
+        if (bPersistentArgs && arguments.has_value() && arguments.value().valid())
+        {
+            jsonFromLuaTable(arguments.value(), p.data);
+
+            // The defaults are applied again when loading, so only the arguments that differ from them are saved:
+            if (p.data.is_object() && defaultArgsJson.is_object())
+            {
+                for (auto it = p.data.begin(); it != p.data.end();)
+                {
+                    auto defaultIt = defaultArgsJson.find(it.key());
+                    if (defaultIt != defaultArgsJson.end() && *defaultIt == *it)
+                        it = p.data.erase(it);
+                    else
+                        ++it;
+                }
+            }
+        }
+
+        assert(p.data.is_object());
+    }
+}
+
+void dibidab::ecs::LuaTemplate::createComponentsForMany(const std::vector<entt::entity> &entities, bool bPersistent)
+{
+    createComponentsForManyWithLuaArguments(entities, sol::optional<sol::table>(), sol::optional<sol::table>(), bPersistent);
+}
+
+void dibidab::ecs::LuaTemplate::createComponentsForManyWithLuaArguments(
+    const std::vector<entt::entity> &entities,
+    const sol::optional<sol::table> &sharedArguments,
+    const sol::optional<sol::table> &perEntityArguments,
+    bool bPersistent
+)
+{
+    if (script.hasReloaded())
+    {
+        runScript();
+    }
+    sol::state_view lua(luaEnvironment.lua_state());
+
+    // Every entity gets its own table, because the defaults are merged into it:
+    auto getArguments = [&] (size_t i) -> sol::optional<sol::table>
+    {
+        sol::optional<sol::table> entityArguments;
+        if (perEntityArguments.has_value())
+        {
+            entityArguments = perEntityArguments.value()[i + 1].get<sol::optional<sol::table>>();
+        }
+        if (!sharedArguments.has_value())
+        {
+            return entityArguments;
+        }
+        sol::table arguments = lua.create_table();
+        for (const auto &[key, value] : sharedArguments.value())
+        {
+            arguments[key] = value;
+        }
+        if (entityArguments.has_value())
+        {
+            for (const auto &[key, value] : entityArguments.value())
+            {
+                arguments[key] = value;
+            }
+        }
+        return arguments;
+    };
+
+    if (!luaCreateBatch.valid())
+    {
+        for (size_t i = 0; i < entities.size(); i++)
+        {
+            createComponentsWithLuaArguments(entities[i], getArguments(i), bPersistent);
+        }
+        return;
+    }
+    try
+    {
+        sol::table entitiesTable = lua.create_table(int(entities.size()), 0);
+        sol::table argumentsTable = lua.create_table(int(entities.size()), 0);
+        for (size_t i = 0; i < entities.size(); i++)
+        {
+            sol::optional<sol::table> arguments = getArguments(i);
+            prepareEntity(entities[i], arguments, bPersistent);
+            entitiesTable[i + 1] = entities[i];
+            if (arguments.has_value())
+            {
+                argumentsTable[i + 1] = arguments.value();
+            }
+        }
+        const sol::protected_function_result result = luaCreateBatch(entitiesTable, argumentsTable, bPersistent);
         if (!result.valid())
         {
             throw gu_err(result.get<sol::error>().what());
         }
-        // NOTE!!: ALL REFERENCES TO COMPONENTS MIGHT BE BROKEN AFTER CALLING luaCreateComponents. (EnTT might resize containers)
     }
     catch (std::exception &exception)
     {
-        std::cerr << "Error while creating entity using " << script.getLoadedAsset()->fullPath << ":" << std::endl;
+        std::cerr << "Error while creating entities using " << script.getLoadedAsset()->fullPath << ":" << std::endl;
         std::cerr << exception.what() << std::endl;
+
+        // Don't leave a partially created batch behind:
+        for (const entt::entity e : entities)
+        {
+            if (engine->entities.valid(e))
+            {
+                engine->entities.destroy(e);
+            }
+        }
+        std::cerr << "Destroyed the " << entities.size() << " entities of the batch" << std::endl;
+    }
+}
+
+bool dibidab::ecs::LuaTemplate::bakePrefab(entt::entity e, Prefab &prefab)
+{
+    const entt::registry &registry = engine->entities;
+    if (const LuaScripted *scripted = registry.try_get<LuaScripted>(e))
+    {
+        if (scripted->updateFunc.valid() || scripted->onDestroyFunc.valid() || !scripted->timeoutFuncs.empty() || scripted->saveData.valid())
+        {
+            std::cerr << "Cannot bake prefab of template '" << name << "', create() set Lua callbacks or data" << std::endl;
+            return false;
+        }
+    }
+    if (engine->getName(e) != nullptr)
+    {
+        std::cerr << "Cannot bake prefab of template '" << name << "', create() gave the entity a name" << std::endl;
+        return false;
+    }
+    if (registry.has<EventEmitter>(e))
+    {
+        std::cerr << "Cannot bake prefab of template '" << name << "', create() added event listeners" << std::endl;
+        return false;
+    }
+    const ComponentInfo *persistentInfo = findComponentInfo<Persistent>();
+    const ComponentInfo *luaScriptedInfo = findComponentInfo<LuaScripted>();
+
+    size_t nrOfReflectedComponents = 0;
+    for (const auto &[componentName, info] : getAllComponentInfos())
+    {
+        if (!info.hasComponent(e, registry))
+        {
+            continue;
+        }
+        nrOfReflectedComponents++;
+        // These are set by `createComponentsWithLuaArguments()` itself:
+        if (&info == persistentInfo || &info == luaScriptedInfo)
+        {
+            continue;
+        }
+        if (info.copyComponent != nullptr)
+        {
+            if (prefab.prototype == entt::null)
+            {
+                prefab.prototype = prefabPrototypes.create();
+            }
+            info.copyComponent(e, registry, prefab.prototype, prefabPrototypes);
+            prefab.components.push_back(&info);
+        }
+        else if (info.getJsonArray != nullptr && info.setFromJson != nullptr)
+        {
+            info.getJsonArray(e, registry, prefab.jsonComponents.emplace_back(&info, json()).second);
+        }
+        else
+        {
+            std::cerr << "Cannot bake prefab of template '" << name << "', " << componentName << " cannot be copied" << std::endl;
+            return false;
+        }
+    }
+    // Components without ComponentInfo (added from C++, or internal ones like those of Observers) would not be stamped:
+    size_t nrOfComponents = 0;
+    registry.visit(e, [&] (const auto)
+    {
+        nrOfComponents++;
+    });
+    if (nrOfComponents != nrOfReflectedComponents)
+    {
+        std::cerr << "Cannot bake prefab of template '" << name << "', create() added components that are not reflected" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void dibidab::ecs::LuaTemplate::stampPrefab(const Prefab &prefab, entt::entity e)
+{
+    for (const ComponentInfo *component : prefab.components)
+    {
+        component->copyComponent(prefab.prototype, prefabPrototypes, e, engine->entities);
     }
+    for (const auto &[component, jsonArray] : prefab.jsonComponents)
+    {
+        component->setFromJson(jsonArray, e, engine->entities);
+    }
+}
+
+void dibidab::ecs::LuaTemplate::setDefaultArgs(const sol::table &table)
+{
+    defaultArgs = table;
 }
 
 const std::string &dibidab::ecs::LuaTemplate::getDescription() const
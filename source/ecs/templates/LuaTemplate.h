@@ -6,8 +6,58 @@
 #include "../../level/room/Room.h"
 #include "../../lua/luau.h"
 
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+namespace dibidab
+{
+    struct ComponentInfo;
+}
+
 namespace dibidab::ecs
 {
+    /**
+     * The Lua templates in a template directory, shared by all Engines (Rooms).
+     * An Engine only creates the LuaTemplate (and runs its script) when the template is used for the first time.
+     */
+    struct LuaTemplateDefinitions
+    {
+        struct Definition
+        {
+            std::string name;
+            std::string assetPath;
+        };
+        // By hash of the name:
+        std::map<int, Definition> definitions;
+        std::vector<std::string> names;
+    };
+
+    /**
+     * Finds the Lua template scripts in the directory. Scripts whose name starts with '_' are skipped.
+     * The result is cached, and only found again after `invalidateLuaTemplateDefinitions()`, or if the number of loaded scripts changed.
+     */
+    std::shared_ptr<const LuaTemplateDefinitions> getLuaTemplateDefinitions(const std::string &directoryPath);
+
+    /**
+     * Makes `getLuaTemplateDefinitions()` find the scripts again, and Engines pick up the new definitions when they look up a template.
+     * Call this after (re)loading assets, because scripts can be renamed or replaced without changing the number of scripts.
+     * dibidab does this itself when it reloads assets.
+     */
+    void invalidateLuaTemplateDefinitions();
+
+    /**
+     * A template whose components are created by the `create()` function of a Lua script.
+     *
+     * If the script calls `enablePrefabBaking()`, the components created for a combination of arguments are recorded in a prefab,
+     * and later entities with the same arguments get copies of those components instead of calling `create()` again.
+     * Only do this if `create()` gives the same result for the same arguments, and only adds components to the entity:
+     * no random values, no names, no other entities, no Lua callbacks, and no references to the entity itself.
+     * Prefabs are only used for entities that have no components yet, and are discarded when the script reloads.
+     *
+     * Arguments that are not given are copied from `defaultArgs` into the arguments table.
+     * Persistent entities only save the arguments that differ from `defaultArgs`.
+     */
     class LuaTemplate : public Template
     {
       public:
@@ -27,19 +77,74 @@ namespace dibidab::ecs
 
         void createComponentsWithLuaArguments(entt::entity, sol::optional<sol::table> arguments, bool bPersistent);
 
+        void createComponentsForMany(const std::vector<entt::entity> &, bool bPersistent) override;
+
+        /**
+         * If the script has a `createBatch(entities, arguments, persistent)` function, it is called once for all entities,
+         * with a list of entities and a list with the arguments of each entity. Otherwise `create()` is called for every entity.
+         * If preparing the entities or `createBatch()` fails, all entities of the batch are destroyed.
+         *
+         * @param sharedArguments Arguments for all entities.
+         * @param perEntityArguments List of arguments per entity, these override `sharedArguments`.
+         */
+        void createComponentsForManyWithLuaArguments(
+            const std::vector<entt::entity> &,
+            const sol::optional<sol::table> &sharedArguments,
+            const sol::optional<sol::table> &perEntityArguments,
+            bool bPersistent
+        );
+
         sol::environment &getTemplateEnvironment();
 
+        // Prefabs are not recorded for more combinations of arguments than this:
+        static constexpr int MAX_PREFABS = 64;
+
       protected:
         void runScript();
 
         std::string getUniqueID();
 
       private:
+        struct Prefab
+        {
+            // Entity in `prefabPrototypes` with the components that `create()` added:
+            entt::entity prototype = entt::null;
+            std::vector<const ComponentInfo *> components;
+            // Components without `ComponentInfo::copyComponent` are stamped from Json instead:
+            std::vector<std::pair<const ComponentInfo *, json>> jsonComponents;
+            // False if `create()` did something with these arguments that cannot be copied:
+            bool bUsable = true;
+        };
+
+        /**
+         * Adds the missing default arguments to `arguments`, and adds LuaScripted (and Persistent if `bPersistent`) to the entity.
+         */
+        void prepareEntity(entt::entity, sol::optional<sol::table> &arguments, bool bPersistent);
+
+        /**
+         * Records the components that `create()` added to the entity. Returns false if the result cannot be recorded,
+         * for example if `create()` added event listeners or components without a `ComponentInfo`.
+         */
+        bool bakePrefab(entt::entity, Prefab &);
+
+        void stampPrefab(const Prefab &, entt::entity);
+
+        void setDefaultArgs(const sol::table &);
+
         std::string description;
         sol::table defaultArgs;
+        // `defaultArgs` as Json, updated after running the script:
+        json defaultArgsJson = json::object();
+
+        bool bPrefabBaking = false;
+        // By persistency and arguments, see `getPrefabKey()` in LuaTemplate.cpp:
+        std::unordered_map<std::string, Prefab> prefabs;
+        // Only used to store the prototype entities of `prefabs`, these are never updated:
+        entt::registry prefabPrototypes;
 
         sol::environment luaEnvironment;
         sol::safe_function luaCreateComponents;
+        sol::safe_function luaCreateBatch;
 
         Persistent persistency;
         bool bPersistentArgs = false;
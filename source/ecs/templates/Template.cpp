@@ -2,6 +2,8 @@
 
 #include "../Engine.h"
 
+#include <algorithm>
+
 const std::string &dibidab::ecs::Template::getDescription() const
 {
     static std::string description = "";
@@ -14,3 +16,20 @@ entt::entity dibidab::ecs::Template::create(bool bPersistent)
     createComponents(e, bPersistent);
     return e;
 }
+
+std::vector<entt::entity> dibidab::ecs::Template::createMany(int count, bool bPersistent)
+{
+    std::vector<entt::entity> created(std::max(0, count));
+    engine->entities.reserve(engine->entities.size() + created.size());
+    engine->entities.create(created.begin(), created.end());
+    createComponentsForMany(created, bPersistent);
+    return created;
+}
+
+void dibidab::ecs::Template::createComponentsForMany(const std::vector<entt::entity> &entities, bool bPersistent)
+{
+    for (const entt::entity e : entities)
+    {
+        createComponents(e, bPersistent);
+    }
+}
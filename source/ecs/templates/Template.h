@@ -2,6 +2,7 @@
 #include <entt/entity/fwd.hpp>
 
 #include <string>
+#include <vector>
 
 namespace dibidab::ecs
 {
@@ -20,8 +21,18 @@ namespace dibidab::ecs
 
         entt::entity create(bool bPersistent = false);
 
+        /**
+         * Creates `count` entities at once, and then their components with `createComponentsForMany()`.
+         */
+        std::vector<entt::entity> createMany(int count, bool bPersistent = false);
+
         virtual void createComponents(entt::entity, bool bPersistent = false) = 0;
 
+        /**
+         * Calls `createComponents()` for every entity by default. Override to handle the whole batch at once.
+         */
+        virtual void createComponentsForMany(const std::vector<entt::entity> &, bool bPersistent = false);
+
       protected:
 
         virtual ~Template() = default;
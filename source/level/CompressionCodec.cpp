@@ -0,0 +1,261 @@
+#include "CompressionCodec.h"
+
+#include <utils/gu_error.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <optional>
+#include <string>
+
+namespace
+{
+    using namespace dibidab::level;
+
+    std::vector<unsigned char> compressZlib(const unsigned char *data, size_t size, int level)
+    {
+        uLongf compressedSize = compressBound(uLong(size));
+        std::vector<unsigned char> compressed(compressedSize);
+        if (compress2(compressed.data(), &compressedSize, data, uLong(size), level < 0 ? Z_DEFAULT_COMPRESSION : std::min(level, 9)) != Z_OK)
+        {
+            throw gu_err("Error while compressing with zlib");
+        }
+        compressed.resize(compressedSize);
+        return compressed;
+    }
+
+    bool decompressZlib(const unsigned char *data, size_t size, unsigned char *out, size_t outSize)
+    {
+        if (outSize == 0)
+        {
+            // uncompress() does not report the decompressed size if there is no room for it, so give it room for 1 byte:
+            unsigned char byte;
+            uLongf decompressedSize = 1;
+            return uncompress(&byte, &decompressedSize, data, uLong(size)) == Z_OK && decompressedSize == 0;
+        }
+        uLongf decompressedSize = uLongf(outSize);
+        return uncompress(out, &decompressedSize, data, uLong(size)) == Z_OK && decompressedSize == outSize;
+    }
+
+    std::vector<unsigned char> compressStore(const unsigned char *data, size_t size, int)
+    {
+        return std::vector<unsigned char>(data, data + size);
+    }
+
+    bool decompressStore(const unsigned char *data, size_t size, unsigned char *out, size_t outSize)
+    {
+        if (size != outSize)
+        {
+            return false;
+        }
+        std::copy(data, data + size, out);
+        return true;
+    }
+
+    /**
+     * A byte oriented LZ77 codec in the style of LZ4, made for decompression speed rather than ratio.
+     *
+     * The data is a list of sequences. Each sequence starts with a token: the number of literals in the upper 4 bits,
+     * and the match length minus MIN_MATCH in the lower 4 bits. If either is 15, more bytes are added to it until a byte is not 255.
+     * The token is followed by the literals, and then by the offset of the match (uint16, little endian).
+     * The last sequence only has literals.
+     */
+    namespace fast_lz
+    {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr int HASH_BITS = 14;
+
+        uint32_t read32(const unsigned char *p)
+        {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(uint32_t));
+            return value;
+        }
+
+        uint32_t hash(uint32_t sequence)
+        {
+            return (sequence * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        void writeLength(std::vector<unsigned char> &out, size_t length)
+        {
+            for (; length >= 255; length -= 255)
+            {
+                out.push_back(255);
+            }
+            out.push_back((unsigned char) length);
+        }
+
+        bool readLength(const unsigned char *&in, const unsigned char *end, size_t &length)
+        {
+            unsigned char byte;
+            do
+            {
+                if (in == end)
+                {
+                    return false;
+                }
+                byte = *in++;
+                length += byte;
+            }
+            while (byte == 255);
+            return true;
+        }
+
+        /**
+         * Writes a sequence. A `matchLength` of 0 means it is the last sequence.
+         */
+        void writeSequence(
+            std::vector<unsigned char> &out, const unsigned char *literals, size_t nrOfLiterals, size_t offset, size_t matchLength
+        )
+        {
+            const size_t matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+            out.push_back((unsigned char) (std::min<size_t>(nrOfLiterals, 15) << 4 | std::min<size_t>(matchCode, 15)));
+            if (nrOfLiterals >= 15)
+            {
+                writeLength(out, nrOfLiterals - 15);
+            }
+            out.insert(out.end(), literals, literals + nrOfLiterals);
+            if (matchLength == 0)
+            {
+                return;
+            }
+            out.push_back((unsigned char) (offset & 255));
+            out.push_back((unsigned char) (offset >> 8));
+            if (matchCode >= 15)
+            {
+                writeLength(out, matchCode - 15);
+            }
+        }
+
+        std::vector<unsigned char> compress(const unsigned char *data, size_t size, int)
+        {
+            std::vector<unsigned char> out;
+            out.reserve(size / 2 + 16);
+
+            // Position + 1 of the last 4 bytes with the same hash, 0 if none:
+            std::vector<size_t> table(size_t(1) << HASH_BITS, 0);
+            size_t pos = 0, anchor = 0, nrOfMisses = 0;
+            while (pos + MIN_MATCH <= size)
+            {
+                const uint32_t sequence = read32(data + pos);
+                size_t &tableEntry = table[hash(sequence)];
+                const size_t candidate = tableEntry;
+                tableEntry = pos + 1;
+
+                if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || read32(data + candidate - 1) != sequence)
+                {
+                    // Move faster through data that does not compress:
+                    pos += 1 + (nrOfMisses++ >> 5);
+                    continue;
+                }
+                nrOfMisses = 0;
+                const size_t match = candidate - 1;
+                size_t length = MIN_MATCH;
+                while (pos + length < size && data[match + length] == data[pos + length])
+                {
+                    length++;
+                }
+                writeSequence(out, data + anchor, pos - anchor, pos - match, length);
+                pos += length;
+                anchor = pos;
+            }
+            writeSequence(out, data + anchor, size - anchor, 0, 0);
+            return out;
+        }
+
+        bool decompress(const unsigned char *data, size_t size, unsigned char *out, size_t outSize)
+        {
+            const unsigned char *in = data, *end = data + size;
+            size_t outPos = 0;
+            while (in < end)
+            {
+                const unsigned char token = *in++;
+
+                size_t nrOfLiterals = token >> 4;
+                if (nrOfLiterals == 15 && !readLength(in, end, nrOfLiterals))
+                {
+                    return false;
+                }
+                if (nrOfLiterals > size_t(end - in) || nrOfLiterals > outSize - outPos)
+                {
+                    return false;
+                }
+                std::copy(in, in + nrOfLiterals, out + outPos);
+                in += nrOfLiterals;
+                outPos += nrOfLiterals;
+
+                if (in == end)
+                {
+                    break; // The last sequence has no match.
+                }
+                if (end - in < 2)
+                {
+                    return false;
+                }
+                const size_t offset = size_t(in[0]) | size_t(in[1]) << 8;
+                in += 2;
+                size_t matchLength = token & 15;
+                if (matchLength == 15 && !readLength(in, end, matchLength))
+                {
+                    return false;
+                }
+                matchLength += MIN_MATCH;
+                if (offset == 0 || offset > outPos || matchLength > outSize - outPos)
+                {
+                    return false;
+                }
+                const unsigned char *match = out + outPos - offset;
+                if (offset >= matchLength)
+                {
+                    std::memcpy(out + outPos, match, matchLength);
+                }
+                else
+                {
+                    // The match overlaps with what it produces, so it repeats the last `offset` bytes:
+                    for (size_t i = 0; i < matchLength; i++)
+                    {
+                        out[outPos + i] = match[i];
+                    }
+                }
+                outPos += matchLength;
+            }
+            return outPos == outSize;
+        }
+    }
+
+    std::array<std::optional<CompressionCodec>, 256> &getCodecs()
+    {
+        static std::array<std::optional<CompressionCodec>, 256> codecs = []
+        {
+            std::array<std::optional<CompressionCodec>, 256> builtIn;
+            builtIn[size_t(level_file::Compression::Zlib)] = CompressionCodec { "zlib", compressZlib, decompressZlib };
+            builtIn[size_t(level_file::Compression::Store)] = CompressionCodec { "store", compressStore, decompressStore };
+            builtIn[size_t(level_file::Compression::FastLz)] = CompressionCodec { "fast_lz", fast_lz::compress, fast_lz::decompress };
+            return builtIn;
+        }();
+        return codecs;
+    }
+}
+
+void dibidab::level::registerCompressionCodec(level_file::Compression id, const CompressionCodec &codec)
+{
+    if (codec.compress == nullptr || codec.decompress == nullptr)
+    {
+        throw gu_err("Compression codec " + std::to_string(int(id)) + " should be able to compress and decompress");
+    }
+    getCodecs()[size_t(id)] = codec;
+}
+
+const dibidab::level::CompressionCodec &dibidab::level::getCompressionCodec(level_file::Compression id)
+{
+    const std::optional<CompressionCodec> &codec = getCodecs()[size_t(id)];
+    if (!codec.has_value())
+    {
+        throw gu_err("Unknown compression: " + std::to_string(int(id)));
+    }
+    return *codec;
+}
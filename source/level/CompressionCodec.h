@@ -0,0 +1,38 @@
+#pragma once
+#include "LevelFile.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace dibidab::level
+{
+    /**
+     * Compresses and decompresses the sections of level files and journals.
+     * The id of the codec (`level_file::Compression`) is stored per section, so sections of different codecs can be mixed in one file.
+     */
+    struct CompressionCodec
+    {
+        const char *name = nullptr;
+
+        /**
+         * @param level Codec specific, -1 is the codec's default.
+         */
+        std::vector<unsigned char> (*compress)(const unsigned char *data, size_t size, int level) = nullptr;
+
+        /**
+         * Returns false if the data is invalid, or does not decompress to exactly `outSize` bytes.
+         */
+        bool (*decompress)(const unsigned char *data, size_t size, unsigned char *out, size_t outSize) = nullptr;
+    };
+
+    /**
+     * Registers (or replaces) the codec for an id. The built-in codecs are registered already, see `level_file::Compression`.
+     * Games should use ids from 128 on. Do not call this while Levels are being loaded or saved.
+     */
+    void registerCompressionCodec(level_file::Compression id, const CompressionCodec &);
+
+    /**
+     * Throws if no codec is registered for the id.
+     */
+    const CompressionCodec &getCompressionCodec(level_file::Compression id);
+}
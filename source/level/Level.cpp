@@ -1,17 +1,43 @@
 #include "Level.h"
 #include "room/Room.h"
+#include "LevelFile.h"
+#include "LevelJournal.h"
+#include "room/EntityColumns.h"
 
 #include "../ecs/components/Player.dibidab.h"
 #include "../ecs/templates/Template.h"
-#include "../dibidab/dibidab.h"
+#include "../dibidab/dibidab_core.h"
+#include "../threading/WorkerPool.h"
+#include "../profiling/TimingStats.h"
+#include "../replay/InputReplay.h"
 
 #include <files/file_utils.h>
 #include <gu/profiler.h>
 
-#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <numeric>
+#include <optional>
 
 std::function<dibidab::level::Room *(const json &)> dibidab::level::Level::customRoomLoader;
 
+namespace
+{
+    dibidab::level::Room *roomFromJson(const json &roomJson)
+    {
+        if (dibidab::level::Level::customRoomLoader)
+        {
+            return dibidab::level::Level::customRoomLoader(roomJson);
+        }
+        auto *room = new dibidab::level::Room;
+        room->loadJsonData(roomJson);
+        return room;
+    }
+}
+
 void dibidab::level::Level::setPaused(bool bInPaused)
 {
     if (bPaused == bInPaused)
@@ -19,53 +45,208 @@ void dibidab::level::Level::setPaused(bool bInPaused)
         return;
     }
     bPaused = bInPaused;
+    for (Room *room : rooms)
+    {
+        if (room != nullptr)
+        {
+            room->invalidateSystemSchedule();
+        }
+    }
     onPauseChanged(bInPaused);
 }
 
+void dibidab::level::Level::setRoomWorkerPool(threading::WorkerPool *pool)
+{
+    if (updating)
+    {
+        throw gu_err("Cannot change room worker pool while updating level!");
+    }
+    roomWorkerPool = pool;
+}
+
 void dibidab::level::Level::initialize()
 {
     int i = 0;
     for (auto &room : rooms)
     {
-        room->roomI = i++;
-        room->initialize(this);
+        if (room != nullptr)
+        {
+            room->roomI = i;
+            room->initialize(this);
+        }
+        i++;
     }
     initialized = true;
     if (rooms.size() > 0)
     {
-        Room *spawnRoom = rooms[0];
-        spawnRoom->getTemplate("Player").create(false);
+        Room &spawnRoom = getRoom(0);
+        spawnRoom.getTemplate("Player").create(false);
+    }
+}
+
+void dibidab::level::Level::setEntityLoadingBudget(double milliseconds)
+{
+    entityLoadingBudget = std::max(0.0, milliseconds);
+}
+
+void dibidab::level::Level::continueLoadingRooms()
+{
+    // Rooms that started loading with a budget finish at once when the budget is removed:
+    const auto deadline = entityLoadingBudget > 0.0
+        ? std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(entityLoadingBudget)
+        )
+        : std::chrono::steady_clock::time_point::max();
+
+    for (Room *room : rooms)
+    {
+        if (room != nullptr && room->isLoadingPersistentEntities() && !room->continueLoadingPersistentEntities(deadline))
+        {
+            break;
+        }
     }
 }
 
+void dibidab::level::Level::setFixedTimestep(int updatesPerSecond, int inMaxUpdatesPerFrame)
+{
+    assert(updatesPerSecond >= 0 && inMaxUpdatesPerFrame > 0);
+    fixedUpdatesPerSecond = updatesPerSecond;
+    maxUpdatesPerFrame = inMaxUpdatesPerFrame;
+    updateAccumulator = 0;
+    interpolationAlpha = 1;
+}
+
 void dibidab::level::Level::update(double deltaTime)
 {
     gu::profiler::Zone levelUpdateZone("level update");
+    static profiling::RollingTimings &levelUpdateTimings = profiling::getTimings("level update");
+    profiling::ScopedTiming timing(&levelUpdateTimings);
+    if (pendingSave.valid() && pendingSave.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        // Calls onSaved:
+        waitForSave();
+    }
+    continueLoadingRooms();
+
     updating = true;
+    replay::beginFrame(deltaTime);
+
+    if (fixedUpdatesPerSecond <= 0)
+    {
+        updateRooms(deltaTime);
+        nrOfUpdatesLastFrame = 1;
+    }
+    else
+    {
+        const double fixedDeltaTime = 1.0 / fixedUpdatesPerSecond;
+        updateAccumulator += deltaTime;
 
+        nrOfUpdatesLastFrame = 0;
+        while (updateAccumulator >= fixedDeltaTime && nrOfUpdatesLastFrame < maxUpdatesPerFrame)
+        {
+            updateRooms(fixedDeltaTime);
+            updateAccumulator -= fixedDeltaTime;
+            nrOfUpdatesLastFrame++;
+        }
+        if (updateAccumulator >= fixedDeltaTime)
+        {
+            // Could not catch up, drop the time instead of trying to catch up even more next frame:
+            updateAccumulator = std::fmod(updateAccumulator, fixedDeltaTime);
+        }
+        interpolationAlpha = updateAccumulator / fixedDeltaTime;
+    }
+
+    replay::endFrame();
+    updating = false;
+
+    deactivateLeastRecentlyNeededRooms();
+}
+
+void dibidab::level::Level::updateRooms(double deltaTime)
+{
     time += deltaTime;
-    for (int i = 0; i < rooms.size(); i++)
+
+    roomsToUpdate.clear();
+    for (Room *room : rooms)
     {
-        Room *room = rooms[i];
-        if (room->entities.empty<ecs::Player>())
+        if (room == nullptr || room->isLoadingPersistentEntities())
         {
             continue;
         }
-        room->update(deltaTime);
+        RoomSimulation simulation = RoomSimulation::Full;
+        if (room->entities.empty<ecs::Player>())
+        {
+            simulation = roomSimulationPolicy ? roomSimulationPolicy(*room) : RoomSimulation::Frozen;
+        }
+
+        if (simulation == RoomSimulation::Full)
+        {
+            room->bUpdatingInBackground = false;
+            room->backgroundUpdateAccumulator = -1.0;
+            roomsToUpdate.emplace_back(room, deltaTime);
+        }
+        else if (simulation == RoomSimulation::Background && backgroundUpdatesPerSecond > 0.0f)
+        {
+            const double backgroundDeltaTime = 1.0 / backgroundUpdatesPerSecond;
+            if (room->backgroundUpdateAccumulator < 0.0)
+            {
+                // Start at a random point, so that not all background rooms are updated in the same frame:
+                room->backgroundUpdateOffset = mu::random() * backgroundDeltaTime;
+                room->backgroundUpdateAccumulator = room->backgroundUpdateOffset;
+            }
+            room->backgroundUpdateAccumulator += deltaTime;
+            if (room->backgroundUpdateAccumulator >= backgroundDeltaTime)
+            {
+                room->bUpdatingInBackground = true;
+                // Only the time that really passed:
+                roomsToUpdate.emplace_back(room, room->backgroundUpdateAccumulator - room->backgroundUpdateOffset);
+                room->backgroundUpdateAccumulator = 0.0;
+                room->backgroundUpdateOffset = 0.0;
+            }
+        }
+        else
+        {
+            room->backgroundUpdateAccumulator = -1.0;
+        }
     }
 
-    updating = false;
+    for (const auto &[room, roomDeltaTime] : roomsToUpdate)
+    {
+        room->lastNeededTime = time;
+    }
+
+    if (roomWorkerPool != nullptr && roomsToUpdate.size() > 1)
+    {
+        threading::TaskGroup roomUpdates(roomWorkerPool);
+        for (const auto &[room, roomDeltaTime] : roomsToUpdate)
+        {
+            roomUpdates.run([room = room, roomDeltaTime = roomDeltaTime]
+            {
+                room->update(roomDeltaTime);
+            });
+        }
+        roomUpdates.wait();
+    }
+    else
+    {
+        for (const auto &[room, roomDeltaTime] : roomsToUpdate)
+        {
+            room->update(roomDeltaTime);
+        }
+    }
 }
 
 #define DEFAULT_LEVEL_PATH "assets/default_level.lvl"
 
 dibidab::level::Level::~Level()
 {
+    waitForSave();
     if (bSaveOnDestruct)
         save(loadedFromFile.empty() ? DEFAULT_LEVEL_PATH : loadedFromFile.c_str());
 
     for (auto r : rooms)
-        r->events.emit(0, "BeforeDelete");
+        if (r)
+            r->events.emit(0, "BeforeDelete");
     for (auto r : rooms)
         delete r;
 }
@@ -73,24 +254,180 @@ dibidab::level::Level::~Level()
 dibidab::level::Room &dibidab::level::Level::getRoom(int i)
 {
     if (i < 0 || i >= rooms.size()) throw gu_err("index out of bounds");
-    return *rooms[i];
+    return rooms[i] ? *rooms[i] : activateRoom(i);
 }
 
 const dibidab::level::Room &dibidab::level::Level::getRoom(int i) const
+{
+    return ((Level *) this)->getRoom(i);
+}
+
+bool dibidab::level::Level::isRoomActive(int i) const
 {
     if (i < 0 || i >= rooms.size()) throw gu_err("index out of bounds");
-    return *rooms[i];
+    return rooms[i] != nullptr;
+}
+
+int dibidab::level::Level::getNrOfActiveRooms() const
+{
+    return int(std::count_if(rooms.begin(), rooms.end(), [] (const Room *room) { return room != nullptr; }));
+}
+
+dibidab::level::Room &dibidab::level::Level::activateRoom(int i)
+{
+    if (i < 0 || i >= rooms.size()) throw gu_err("index out of bounds");
+    if (rooms[i] != nullptr)
+    {
+        rooms[i]->lastNeededTime = time;
+        return *rooms[i];
+    }
+    if (updating && roomWorkerPool != nullptr)
+    {
+        throw gu_err("Cannot activate a room while rooms are updated concurrently!");
+    }
+    RoomSectionData roomData = readInactiveRoom(i);
+
+    Room *room = roomFromJson(roomData.jsonData);
+    assert(room->level == nullptr);
+    room->entityColumnsToLoad = std::move(roomData.entityColumns);
+    loadBinaryData(*room, roomData);
+    room->lastNeededTime = time;
+
+    rooms[i] = room;
+    inactiveRooms[i] = nullptr;
+
+    if (initialized)
+    {
+        room->roomI = i;
+        room->initialize(this);
+    }
+    onRoomActivated(room);
+    return *room;
+}
+
+void dibidab::level::Level::deactivateRoom(int i)
+{
+    if (i < 0 || i >= rooms.size()) throw gu_err("index out of bounds");
+    Room *room = rooms[i];
+    if (room == nullptr)
+    {
+        return;
+    }
+    if (updating)
+    {
+        throw gu_err("Cannot deactivate a room while updating level!");
+    }
+    if (!room->isPersistent())
+    {
+        throw gu_err("Cannot deactivate a room that is not persistent, it would be lost!");
+    }
+    beforeRoomDeactivation(room);
+
+    const RoomSectionData roomData = room->exportForSave();
+
+    auto inactiveRoom = std::make_unique<InactiveRoom>();
+    inactiveRoom->name = room->name;
+    inactiveRoom->compressed = compressRoom(roomData, inactiveRoom->entry, quickCompression);
+    inactiveRoom->bUnsavedChanges = true;
+    inactiveRooms[i] = std::move(inactiveRoom);
+
+    room->events.emit(0, "BeforeDelete");
+    delete room;
+    rooms[i] = nullptr;
+}
+
+void dibidab::level::Level::setMaxActiveRooms(int inMaxActiveRooms)
+{
+    maxActiveRooms = inMaxActiveRooms;
+    if (!updating)
+    {
+        deactivateLeastRecentlyNeededRooms();
+    }
+}
+
+void dibidab::level::Level::loadBinaryData(Room &room, const RoomSectionData &roomData)
+{
+    if (roomData.mappedBinaryData.file != nullptr)
+    {
+        room.loadMappedBinaryData(roomData.mappedBinaryData);
+    }
+    else
+    {
+        room.loadBinaryData(roomData.binaryData.data(), roomData.binaryData.size());
+    }
+}
+
+dibidab::level::RoomSectionData dibidab::level::Level::readInactiveRoom(int i) const
+{
+    const InactiveRoom &inactiveRoom = *inactiveRooms.at(i);
+    if (inactiveRoom.indexInFile >= 0)
+    {
+        return roomReader->readRoom(inactiveRoom.indexInFile);
+    }
+    return decompressRoom(inactiveRoom.entry, inactiveRoom.compressed);
+}
+
+void dibidab::level::Level::deactivateLeastRecentlyNeededRooms()
+{
+    if (maxActiveRooms <= 0 || !initialized)
+    {
+        return;
+    }
+    std::vector<Room *> candidates;
+    for (Room *room : rooms)
+    {
+        if (room != nullptr)
+        {
+            if (!room->entities.empty<ecs::Player>() || room->isLoadingPersistentEntities())
+            {
+                // Rooms with a Player, or that are loading, are needed right now:
+                room->lastNeededTime = time;
+            }
+            else if (room->isPersistent())
+            {
+                candidates.push_back(room);
+            }
+        }
+    }
+    int nrToDeactivate = getNrOfActiveRooms() - maxActiveRooms;
+    if (nrToDeactivate <= 0)
+    {
+        return;
+    }
+    std::sort(candidates.begin(), candidates.end(), [] (const Room *a, const Room *b)
+    {
+        return a->lastNeededTime < b->lastNeededTime;
+    });
+    for (Room *room : candidates)
+    {
+        if (nrToDeactivate-- <= 0)
+        {
+            break;
+        }
+        deactivateRoom(room->getIndexInLevel());
+    }
 }
 
 void dibidab::level::to_json(json &j, const Level &lvl)
 {
     j = json::object({ { "rooms", json::array() } });
-    for (Room *room : lvl.rooms)
+    for (int i = 0; i < lvl.getNrOfRooms(); i++)
     {
-        if (room->isPersistent())
+        if (Room *room = lvl.rooms[i])
         {
-            json &roomJ = j["rooms"].emplace_back();
-            room->exportJsonData(roomJ);
+            if (room->isPersistent())
+            {
+                room->exportJsonData(j["rooms"].emplace_back());
+            }
+        }
+        else
+        {
+            const RoomSectionData roomData = lvl.readInactiveRoom(i);
+            json &roomJson = j["rooms"].emplace_back(roomData.jsonData);
+            if (!roomData.entityColumns.empty())
+            {
+                EntityColumnsReader(roomData.entityColumns.data(), roomData.entityColumns.size()).toJson(roomJson["entities"]);
+            }
         }
     }
 }
@@ -101,14 +438,7 @@ void dibidab::level::from_json(const json &j, Level &lvl)
 
     for (const auto &rJ : roomsJson)
     {
-        if (Level::customRoomLoader)
-            lvl.addRoom(Level::customRoomLoader(rJ));
-        else
-        {
-            Room *r = new Room;
-            r->loadJsonData(rJ);
-            lvl.addRoom(r);
-        }
+        lvl.addRoom(roomFromJson(rJ));
     }
 }
 
@@ -116,119 +446,419 @@ void dibidab::level::Level::deleteRoom(int i)
 {
     assert(i < rooms.size());
 
+    // Inactive Rooms are deleted without activating them first:
     Room *old = rooms[i];
-    beforeRoomDeletion(old);
+    if (old != nullptr)
+    {
+        beforeRoomDeletion(old);
+    }
 
     rooms[i] = rooms.back();
-    rooms[i]->roomI = i;
+    if (rooms[i] != nullptr)
+    {
+        rooms[i]->roomI = i;
+    }
+    inactiveRooms[i] = std::move(inactiveRooms.back());
 
     delete old;
     rooms.pop_back();
+    inactiveRooms.pop_back();
+    roomLayoutVersion++;
 }
 
-typedef uint64 level_data_length_type;
-
-void dibidab::level::Level::save(const char *path) const
+void dibidab::level::Level::save(const char *path, const level_file::CompressionSettings &compression)
 {
-    std::vector<unsigned char> data(sizeof(level_data_length_type), 0u);
+    if (path == nullptr)
+    {
+        path = loadedFromFile.c_str();
+    }
+    if (pendingSave.valid())
+    {
+        // Don't let the background save replace the file after this one:
+        pendingSave.wait();
+    }
+    const bool bOverwritingRoomFile = roomReader != nullptr && roomReader->getPath() == path;
 
-    json::to_cbor(*this, data);
-    *((level_data_length_type *) &data[0]) = data.size() - sizeof(level_data_length_type);
+    try
+    {
+        snapshotForSave(path, compression).write(path);
+    }
+    catch (...)
+    {
+        journal.bValid = false;
+        throw;
+    }
+    // Everything in the journal is in the new file now:
+    deleteLevelJournal(path);
 
-    for (Room *room : rooms)
+    if (bOverwritingRoomFile)
     {
-        if (!room->isPersistent())
+        // All inactive Rooms were written to the new file, so read them from there again instead of keeping them in memory:
+        roomReader = std::make_unique<LevelFileReader>(path);
+        for (int i = 0, indexInFile = 0; i < getNrOfRooms(); i++)
         {
-            continue;
+            if (rooms[i] != nullptr && !rooms[i]->isPersistent())
+            {
+                continue;
+            }
+            if (InactiveRoom *inactiveRoom = inactiveRooms[i].get())
+            {
+                inactiveRoom->indexInFile = indexInFile;
+                inactiveRoom->compressed.clear();
+                inactiveRoom->compressed.shrink_to_fit();
+            }
+            indexInFile++;
         }
-        data.resize(data.size() + sizeof(level_data_length_type));
-        const level_data_length_type dataSizeBeforeRoom = data.size();
-        room->exportBinaryData(data);
-
-        const level_data_length_type roomDataSize = data.size() - dataSizeBeforeRoom;
-        *((level_data_length_type *) (&data[dataSizeBeforeRoom - sizeof(level_data_length_type)])) = roomDataSize;
     }
+}
 
-    std::vector<uint8> compressedData(long(double(12 + data.size()) * 1.1));
-    unsigned long compressedDataSize = compressedData.size();
+void dibidab::level::Level::saveAsync(const char *path, const level_file::CompressionSettings &compression)
+{
+    waitForSave();
 
-    int zResult = compress(&compressedData[0], &compressedDataSize, (const uint8 *) &data[0], data.size());
+    pendingSavePath = path ? path : loadedFromFile;
+    pendingSave = std::async(std::launch::async, [writer = snapshotForSave(pendingSavePath.c_str(), compression), path = pendingSavePath] () mutable
+    {
+        writer.write(path.c_str());
+        deleteLevelJournal(path.c_str());
+    });
+}
 
-    if (zResult != Z_OK)
-        throw gu_err("Error while compressing level");
+void dibidab::level::Level::saveIncremental()
+{
+    waitForSave();
 
-    // store original data size at end of buffer:
-    compressedData.resize(compressedDataSize + sizeof(int));
-    int *originalDataSize = (int *) &compressedData[compressedDataSize];
-    *originalDataSize = int(data.size());
+    const std::string path = loadedFromFile.empty() ? DEFAULT_LEVEL_PATH : loadedFromFile;
+    if (shouldCompactJournal(path))
+    {
+        saveAsync(path.c_str(), fileCompression);
+        return;
+    }
+    std::vector<JournalRecord> records;
+    std::vector<InactiveRoom *> journaledInactiveRooms;
+    try
+    {
+        for (int i = 0; i < getNrOfRooms(); i++)
+        {
+            const int indexInFile = journal.roomIndicesInFile[i];
+            if (indexInFile < 0)
+            {
+                continue;
+            }
+            if (Room *room = rooms[i])
+            {
+                JournalRecord record;
+                record.roomIndex = indexInFile;
+                RoomSectionData roomData;
+                bool bChanged = true;
+                if (room->exportJournalDelta(roomData, record.destroyedEntities, bChanged))
+                {
+                    if (!bChanged)
+                    {
+                        continue;
+                    }
+                    record.type = JournalRecord::Type::Delta;
+                }
+                else
+                {
+                    record.type = JournalRecord::Type::Room;
+                    roomData = room->exportForSave();
+                }
+                record.compressed = compressRoom(roomData, record.entry, quickCompression);
+                records.push_back(std::move(record));
+            }
+            else if (inactiveRooms[i]->bUnsavedChanges)
+            {
+                JournalRecord &record = records.emplace_back();
+                record.roomIndex = indexInFile;
+                record.type = JournalRecord::Type::Room;
+                record.entry = inactiveRooms[i]->entry;
+                record.compressed = inactiveRooms[i]->compressed;
+                journaledInactiveRooms.push_back(inactiveRooms[i].get());
+            }
+        }
+        if (!records.empty())
+        {
+            journal.size = appendToLevelJournal(path.c_str(), journal.size, records);
+        }
+    }
+    catch (...)
+    {
+        // The Rooms already consider their changes saved:
+        journal.bValid = false;
+        throw;
+    }
+    for (InactiveRoom *inactiveRoom : journaledInactiveRooms)
+    {
+        inactiveRoom->bUnsavedChanges = false;
+    }
+}
+
+void dibidab::level::Level::rewriteRoomInFile(int i, const level_file::CompressionSettings &compression)
+{
+    waitForSave();
 
-    fu::writeBinary(path ? path : loadedFromFile.c_str(), (char *) compressedData.data(), compressedData.size());
+    const std::string path = loadedFromFile.empty() ? DEFAULT_LEVEL_PATH : loadedFromFile;
+    if (!journal.bValid || journal.levelFilePath != path || journal.roomLayoutVersion != roomLayoutVersion)
+    {
+        throw gu_err("Cannot rewrite a single room of " + path + ", it does not describe the current rooms. Save the whole Level instead.");
+    }
+    if (journal.size > 0)
+    {
+        throw gu_err("Cannot rewrite a single room of " + path + ", it has a journal. Save the whole Level instead.");
+    }
+    const int indexInFile = journal.roomIndicesInFile.at(i);
+    if (indexInFile < 0)
+    {
+        throw gu_err("Cannot rewrite room #" + std::to_string(i) + " in " + path + ", it is not persistent");
+    }
+    RoomSectionData roomData = rooms[i] != nullptr ? rooms[i]->exportForSave() : readInactiveRoom(i);
+    if (roomData.mappedBinaryData.file != nullptr)
+    {
+        // Don't keep the file mapped while it is replaced:
+        roomData.binaryData.assign(roomData.mappedBinaryData.data, roomData.mappedBinaryData.data + roomData.mappedBinaryData.size);
+        roomData.mappedBinaryData = {};
+    }
+    // Files are replaced after being written, which is not possible on all platforms if the file is still opened for reading.
+    // The sections of the inactive Rooms keep their index in the new file, so they can be read from it after reopening:
+    const bool bRewritingRoomFile = roomReader != nullptr && roomReader->getPath() == path;
+    if (bRewritingRoomFile)
+    {
+        roomReader.reset();
+    }
+    try
+    {
+        rewriteRoomInLevelFile(path.c_str(), indexInFile, roomData, compression);
+    }
+    catch (...)
+    {
+        if (bRewritingRoomFile)
+        {
+            roomReader = std::make_unique<LevelFileReader>(path.c_str());
+        }
+        throw;
+    }
+    if (bRewritingRoomFile)
+    {
+        roomReader = std::make_unique<LevelFileReader>(path.c_str());
+    }
+    if (rooms[i] == nullptr)
+    {
+        inactiveRooms[i]->bUnsavedChanges = false;
+    }
 }
 
-dibidab::level::Level::Level(const char *filePath) : loadedFromFile(filePath)
+bool dibidab::level::Level::shouldCompactJournal(const std::string &path) const
 {
-    if (!fu::exists(filePath))
+    if (!journal.bValid || journal.levelFilePath != path || journal.roomLayoutVersion != roomLayoutVersion)
     {
-        std::cout << "No level file found at " << filePath << ", creating empty Level...\n";
-        return;
+        return true;
     }
-    try // Todo: create a loadCompressed() and saveCompressed() function in gu
+    for (int i = 0; i < getNrOfRooms(); i++)
     {
-        auto compressedData = fu::readBinary(filePath);
+        const bool bSaved = rooms[i] == nullptr || rooms[i]->isPersistent();
+        if (bSaved != (journal.roomIndicesInFile[i] >= 0))
+        {
+            return true;
+        }
+    }
+    if (journalCompactionInterval > 0 && time - journal.lastCompactionTime >= journalCompactionInterval)
+    {
+        return true;
+    }
+    std::error_code error;
+    const uint64_t levelFileSize = std::filesystem::file_size(path, error);
+    return error || double(journal.size) > maxJournalSizeRatio * double(levelFileSize);
+}
 
-        unsigned long compressedDataSize = compressedData.size() - sizeof(int);
+bool dibidab::level::Level::isSaving() const
+{
+    return pendingSave.valid() && pendingSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
 
-        unsigned long originalDataSize = *((int *) &compressedData[compressedDataSize]);
-        unsigned long originalDataSize_ = originalDataSize;
+void dibidab::level::Level::waitForSave()
+{
+    if (!pendingSave.valid())
+    {
+        return;
+    }
+    std::string error;
+    try
+    {
+        pendingSave.get();
+    }
+    catch (std::exception &e)
+    {
+        error = e.what();
+        std::cerr << "Failed to save level to " << pendingSavePath << ":\n" << error << std::endl;
+        journal.bValid = false;
+    }
+    onSaved(pendingSavePath, error);
+}
 
-        std::vector<uint8> uncompressedData(originalDataSize);
+dibidab::level::LevelFileWriter dibidab::level::Level::snapshotForSave(
+    const char *path,
+    const level_file::CompressionSettings &compression
+)
+{
+    // Files are replaced after being written, which is not possible on all platforms if the file is still opened for reading.
+    // So Rooms that are still in the file that will be replaced are kept in memory from now on:
+    const bool bOverwritingRoomFile = roomReader != nullptr && roomReader->getPath() == path;
+
+    journal.bValid = true;
+    journal.levelFilePath = path;
+    journal.roomLayoutVersion = roomLayoutVersion;
+    journal.roomIndicesInFile.assign(getNrOfRooms(), -1);
+    journal.size = 0;
+    journal.lastCompactionTime = time;
+    fileCompression = compression;
+
+    LevelFileWriter writer(compression);
+    for (int i = 0, indexInFile = 0; i < getNrOfRooms(); i++)
+    {
+        if (Room *room = rooms[i])
+        {
+            if (!room->isPersistent())
+            {
+                continue;
+            }
+            writer.addRoom(room->exportForSave());
+        }
+        else
+        {
+            // Inactive Rooms are written without decompressing them:
+            InactiveRoom &inactiveRoom = *inactiveRooms[i];
+            inactiveRoom.bUnsavedChanges = false;
+            if (inactiveRoom.indexInFile >= 0)
+            {
+                std::vector<unsigned char> compressed = roomReader->readCompressedRoom(inactiveRoom.indexInFile, inactiveRoom.entry);
+                if (bOverwritingRoomFile)
+                {
+                    inactiveRoom.indexInFile = -1;
+                    inactiveRoom.compressed = compressed;
+                }
+                writer.addCompressedRoom(inactiveRoom.entry, std::move(compressed));
+            }
+            else
+            {
+                writer.addCompressedRoom(inactiveRoom.entry, inactiveRoom.compressed);
+            }
+        }
+        journal.roomIndicesInFile[i] = indexInFile++;
+    }
+    if (bOverwritingRoomFile)
+    {
+        roomReader.reset();
+    }
+    return writer;
+}
 
-        int zResult = uncompress(&uncompressedData[0], &originalDataSize, &compressedData[0], compressedDataSize);
+dibidab::level::Level::Level(const char *filePath, bool bLoadRoomsLazily, threading::WorkerPool *loadingPool) :
+    loadedFromFile(filePath)
+{
+    if (!fu::exists(filePath))
+    {
+        std::cout << "No level file found at " << filePath << ", creating empty Level...\n";
+        return;
+    }
+    try
+    {
+        auto reader = std::make_unique<LevelFileReader>(filePath);
+        const bool bCurrentVersion = reader->getVersion() == level_file::VERSION;
 
-        if (originalDataSize != originalDataSize_)
+        fileCompression = {};
+        if (!reader->isLegacyFormat() && reader->getNrOfRooms() > 0)
         {
-            throw gu_err("Length of uncompressed data does not match length of original data");
+            fileCompression.compression = reader->getIndexEntry(0).compression;
         }
 
-        if (zResult != Z_OK)
+        // Changes saved after the level file was written:
+        std::vector<JournalRecord> journalRecords;
+        uint64_t journalSize = 0;
+        std::map<int, std::vector<const JournalRecord *>> journalRecordsPerRoom;
+        if (bCurrentVersion)
         {
-            throw gu_err("Error while UNcompressing");
+            journalRecords = readLevelJournal(filePath, &journalSize);
+            for (const JournalRecord &record : journalRecords)
+            {
+                journalRecordsPerRoom[record.roomIndex].push_back(&record);
+            }
         }
 
-        if (uncompressedData.size() <= sizeof(level_data_length_type))
+        // Rooms with changes in the journal are not loaded lazily, so that the journal does not have to be kept around:
+        std::vector<int> roomsToRead;
+        for (int i = 0; i < reader->getNrOfRooms(); i++)
         {
-            throw gu_err("Level file does barely contain any data!");
+            if (!bLoadRoomsLazily || journalRecordsPerRoom.find(i) != journalRecordsPerRoom.end())
+            {
+                roomsToRead.push_back(i);
+            }
         }
-        const level_data_length_type jsonDataLength = *((level_data_length_type *) &uncompressedData[0]);
-
-        const level_data_length_type binaryBegin = sizeof(level_data_length_type) + jsonDataLength;
 
-        if (binaryBegin > uncompressedData.size())
+        // Reading, decompressing and parsing the sections is done in parallel, only creating the Rooms is done on this thread:
+        std::unique_ptr<threading::WorkerPool> temporaryPool;
+        if (loadingPool == nullptr && roomsToRead.size() > 1)
         {
-            throw gu_err("Level file does not contain as much json data as described!");
+            temporaryPool = std::make_unique<threading::WorkerPool>(
+                std::min(threading::WorkerPool::getDefaultNrOfThreads(), int(roomsToRead.size()) - 1)
+            );
+            loadingPool = temporaryPool.get();
         }
-
-        json j = json::from_cbor(
-            &uncompressedData[sizeof(level_data_length_type)],
-            &uncompressedData[binaryBegin]
-        );
-        from_json(j, *this);
-
-        level_data_length_type nextRoomBinaryBegin = binaryBegin;
-        for (Room *room : rooms)
+        std::vector<std::optional<RoomSectionData>> roomSections(reader->getNrOfRooms());
         {
-            if (nextRoomBinaryBegin + sizeof(level_data_length_type) >= uncompressedData.size())
+            threading::TaskGroup readTasks(loadingPool);
+            for (const int i : roomsToRead)
             {
-                break;
+                readTasks.run([&, i]
+                {
+                    RoomSectionData roomData = reader->readRoom(i);
+                    auto roomJournalRecords = journalRecordsPerRoom.find(i);
+                    if (roomJournalRecords != journalRecordsPerRoom.end())
+                    {
+                        for (const JournalRecord *record : roomJournalRecords->second)
+                        {
+                            applyJournalRecord(roomData, *record);
+                        }
+                    }
+                    roomSections[i] = std::move(roomData);
+                });
             }
-            const level_data_length_type roomBinaryBegin = nextRoomBinaryBegin;
-            const level_data_length_type roomBinaryDataLength = *((level_data_length_type *) &uncompressedData[roomBinaryBegin]);
-            nextRoomBinaryBegin += roomBinaryDataLength + sizeof(level_data_length_type);
-            if (nextRoomBinaryBegin > uncompressedData.size())
+            readTasks.wait();
+        }
+
+        for (int i = 0; i < reader->getNrOfRooms(); i++)
+        {
+            if (!roomSections[i].has_value())
             {
-                throw gu_err("Level file does not contain as much binary room data as described for room #" + std::to_string(room->roomI));
+                auto inactiveRoom = std::make_unique<InactiveRoom>();
+                inactiveRoom->name = reader->getRoomName(i);
+                inactiveRoom->indexInFile = i;
+                rooms.push_back(nullptr);
+                inactiveRooms.push_back(std::move(inactiveRoom));
+                continue;
             }
-            room->loadBinaryData(&uncompressedData[roomBinaryBegin + sizeof(level_data_length_type)], roomBinaryDataLength);
+            RoomSectionData roomData = std::move(*roomSections[i]);
+            roomSections[i].reset();
+
+            Room *room = roomFromJson(roomData.jsonData);
+            room->entityColumnsToLoad = std::move(roomData.entityColumns);
+            room->entityDeltasToLoad = std::move(roomData.entityDeltas);
+            addRoom(room);
+            loadBinaryData(*room, roomData);
+        }
+        if (bCurrentVersion)
+        {
+            // Changes can be appended to the journal of this file from now on:
+            journal.bValid = true;
+            journal.levelFilePath = filePath;
+            journal.roomLayoutVersion = roomLayoutVersion;
+            journal.roomIndicesInFile.resize(rooms.size());
+            std::iota(journal.roomIndicesInFile.begin(), journal.roomIndicesInFile.end(), 0);
+            journal.size = journalSize;
+        }
+        if (bLoadRoomsLazily)
+        {
+            roomReader = std::move(reader);
         }
     }
     catch (std::exception &e)
@@ -239,9 +869,9 @@ dibidab::level::Level::Level(const char *filePath) : loadedFromFile(filePath)
 
 dibidab::level::Room *dibidab::level::Level::getRoomByName(const char *n)
 {
-    for (auto &r : rooms)
-        if (r->name == n)
-            return r;
+    for (int i = 0; i < getNrOfRooms(); i++)
+        if (rooms[i] ? rooms[i]->name == n : inactiveRooms[i]->name == n)
+            return &getRoom(i);
     return nullptr;
 }
 
@@ -255,6 +885,8 @@ void dibidab::level::Level::addRoom(Room *r)
     assert(r->level == nullptr);
 
     rooms.push_back(r);
+    inactiveRooms.push_back(nullptr);
+    roomLayoutVersion++;
 
     if (initialized)
     {
@@ -1,5 +1,9 @@
 #pragma once
 #include "room/Room.h"
+#include "LevelFile.h"
+
+#include <future>
+#include <memory>
 
 namespace dibidab::level
 {
@@ -10,14 +14,67 @@ namespace dibidab::level
     {
         double time = 0;
         bool bPaused = false;
+        // nullptr for Rooms that are not active, see `activateRoom()`:
         std::vector<Room *> rooms;
 
+        /**
+         * A Room that is not materialized. Its data is either still in the file the Level was loaded from,
+         * or it was deactivated and is kept as a compressed section.
+         */
+        struct InactiveRoom
+        {
+            std::string name;
+            // Index of the Room in `roomReader`, or -1 if the Room is in `compressed`:
+            int indexInFile = -1;
+            level_file::IndexEntry entry;
+            std::vector<unsigned char> compressed;
+            // True if deactivated since the previous save:
+            bool bUnsavedChanges = false;
+        };
+        // Same size as `rooms`, nullptr for active Rooms:
+        std::vector<std::unique_ptr<InactiveRoom>> inactiveRooms;
+        // Only set if Rooms are loaded lazily from a level file:
+        std::unique_ptr<LevelFileReader> roomReader;
+        int maxActiveRooms = 0;
+        double entityLoadingBudget = 0;
+
+        std::future<void> pendingSave;
+        std::string pendingSavePath;
+
+        // Incremented when Rooms are added or deleted:
+        int roomLayoutVersion = 0;
+
+        /**
+         * What the journal of the level file can describe, see `saveIncremental()`.
+         * Set when the Level is loaded from or completely saved to its file.
+         */
+        struct
+        {
+            bool bValid = false;
+            std::string levelFilePath;
+            int roomLayoutVersion = 0;
+            // Per Room: its index in the level file, or -1 if it is not saved:
+            std::vector<int> roomIndicesInFile;
+            // Where the last valid record of the journal ends, so that appending does not have to read the journal:
+            uint64_t size = 0;
+            double lastCompactionTime = 0;
+        }
+        journal;
+
+        // How the level file was compressed when it was loaded or saved, so that compacting the journal keeps it that way.
+        // The codec level is not stored in level files, so after loading it is the codec's default:
+        level_file::CompressionSettings fileCompression { level_file::Compression::FastLz };
+
         bool updating = false, initialized = false;
-        float updateAccumulator = 0;
-        constexpr static int    // todo, make this overridable:
-            MAX_UPDATES_PER_SEC = 60,
-            MIN_UPDATES_PER_SEC = 60,
-            MAX_UPDATES_PER_FRAME = 1;
+
+        int fixedUpdatesPerSecond = 0;
+        int maxUpdatesPerFrame = 1;
+        double updateAccumulator = 0;
+        double interpolationAlpha = 1;
+        int nrOfUpdatesLastFrame = 0;
+
+        threading::WorkerPool *roomWorkerPool = nullptr;
+        std::vector<std::pair<Room *, double>> roomsToUpdate;
 
         friend void to_json(json &j, const Level &lvl);
 
@@ -40,22 +97,88 @@ namespace dibidab::level
 
         Level() = default;
 
-        Level(const char *filePath);
+        /**
+         * @param bLoadRoomsLazily If true, Rooms stay in the file until they are activated (see `activateRoom()`).
+         * @param loadingPool Pool on which the Rooms are read, decompressed and parsed in parallel.
+         *  If nullptr, a temporary pool is used when more than one Room is loaded.
+         *  The Rooms (and their entities) are always created on the calling thread.
+         */
+        Level(const char *filePath, bool bLoadRoomsLazily = false, threading::WorkerPool *loadingPool = nullptr);
+
+        /**
+         * Decides how Rooms WITHOUT a Player are simulated. Rooms with a Player are always fully simulated.
+         * If not set, Rooms without a Player are frozen.
+         *
+         * This allows Rooms near the player to keep evolving, at a lower cost.
+         */
+        std::function<RoomSimulation(const Room &)> roomSimulationPolicy;
 
+        /**
+         * How often Rooms with `RoomSimulation::Background` are updated.
+         * Their delta time will be the time passed since their previous update.
+         */
+        float backgroundUpdatesPerSecond = 5.0f;
+
+        // Only called for active Rooms, inactive Rooms are deleted without activating them:
         delegate<void(Room *)> beforeRoomDeletion;
+        delegate<void(Room *)> onRoomActivated;
+        delegate<void(Room *)> beforeRoomDeactivation;
         delegate<void(bool)> onPauseChanged;
 
         int getNrOfRooms() const
         { return rooms.size(); }
 
+        /**
+         * Activates the Room if it is not active.
+         */
         Room &getRoom(int i);
 
         const Room &getRoom(int i) const;
 
+        /**
+         * Activates the Room if it is not active.
+         */
         Room *getRoomByName(const char *);
 
         const Room *getRoomByName(const char *) const;
 
+        bool isRoomActive(int i) const;
+
+        int getNrOfActiveRooms() const;
+
+        /**
+         * Creates (and initializes if the Level is initialized) the Room from its serialized data, if it is not active yet.
+         * Cannot be called while Rooms are updated concurrently.
+         */
+        Room &activateRoom(int i);
+
+        /**
+         * Serializes the Room into a compressed section, and deletes it. It will be activated again when needed.
+         * Throws if the Room is not persistent, or if the Level is updating.
+         */
+        void deactivateRoom(int i);
+
+        /**
+         * If more Rooms than this are active after an update, the persistent Rooms without a Player that were needed least recently
+         * are deactivated. A Room is needed when it has a Player, is updated, or is activated. 0 means no limit (default).
+         */
+        void setMaxActiveRooms(int maxActiveRooms);
+
+        /**
+         * If more than 0, Rooms load their persistent entities in batches, spending at most this many milliseconds per frame
+         * (for all loading Rooms together) in `update()`. Rooms are not updated until they are loaded,
+         * so they can be activated behind a loading animation (see `Room::getLoadingProgress()`).
+         * 0 means Rooms load all their entities when they are initialized (default).
+         */
+        void setEntityLoadingBudget(double milliseconds);
+
+        double getEntityLoadingBudget() const
+        { return entityLoadingBudget; }
+
+        /**
+         * Deletes the Room at index `i`, and moves the last Room to index `i`.
+         * If the Room is inactive, its saved data is dropped without activating it.
+         */
         void deleteRoom(int i);
 
         void addRoom(Room *);
@@ -68,6 +191,42 @@ namespace dibidab::level
 
         void setPaused(bool bPaused);
 
+        /**
+         * If set, Rooms are updated concurrently on the given pool. If nullptr (the default), one after another.
+         *
+         * Contract while Rooms are updated concurrently:
+         *  - A Room's registry is only accessed by the thread that updates that Room.
+         *  - Systems that can access shared state like Lua and the AssetManager are updated on the thread that calls
+         *    `update()`, one at a time across all Rooms (see `Engine::updateSystem()`).
+         *  - The Level's time is advanced before the Rooms are updated, and is read-only during their update.
+         *  - Rooms cannot be added or deleted, and the Level cannot be (un)paused, during the update.
+         */
+        void setRoomWorkerPool(threading::WorkerPool *pool);
+
+        /**
+         * Makes `update()` simulate the Rooms in fixed steps of 1 / `updatesPerSecond` seconds,
+         * independent of the frame rate. Pass 0 to update the Rooms once per frame with the frame's delta time (default).
+         *
+         * @param maxUpdatesPerFrame Maximum number of steps simulated in one frame to catch up.
+         *  Time that could not be caught up with (after a hitch for example) is dropped, so that a slow frame
+         *  does not cause even more steps the next frame.
+         */
+        void setFixedTimestep(int updatesPerSecond, int maxUpdatesPerFrame = 4);
+
+        int getFixedUpdatesPerSecond() const
+        { return fixedUpdatesPerSecond; }
+
+        /**
+         * Returns how far (0 to 1) the real time is between the previous and the next fixed step.
+         * Can be used to interpolate between the previous and current simulated state when rendering.
+         * Always 1 if no fixed timestep is used.
+         */
+        double getInterpolationAlpha() const
+        { return interpolationAlpha; }
+
+        int getNrOfUpdatesLastFrame() const
+        { return nrOfUpdatesLastFrame; }
+
         bool isUpdating() const
         { return updating; }
 
@@ -75,15 +234,93 @@ namespace dibidab::level
 
         /**
          * Updates the level and it's Rooms.
+         * With a fixed timestep this can result in zero or more updates of the Rooms, see `setFixedTimestep()`.
          *
          * @param deltaTime Time passed since previous update
          */
         void update(double deltaTime);
 
-        void save(const char *path) const;
+        /**
+         * Saves all persistent Rooms to a level file with a separately compressed section per Room (see LevelFile.h).
+         * Level files in the legacy single-buffer format can still be loaded, and are converted when saved again.
+         *
+         * The file is written next to `path` first, and then renamed to `path`.
+         *
+         * Not const: saving marks inactive Rooms as saved, may move their data out of the file being replaced, and resets the journal.
+         *
+         * @param compression For example `{ level_file::Compression::Zlib, 9, true }` for shipping a level with the game.
+         */
+        void save(const char *path, const level_file::CompressionSettings &compression = {});
+
+        /**
+         * Takes a snapshot of all persistent Rooms on the calling thread, then encodes, compresses and writes it on a
+         * background thread, like `save()`. Waits for the previous background save first if it has not finished yet.
+         * Use this for autosaves, to prevent hitches.
+         *
+         * @param path If nullptr, the file the Level was loaded from.
+         */
+        void saveAsync(const char *path = nullptr, const level_file::CompressionSettings &compression = {});
+
+        bool isSaving() const;
+
+        /**
+         * Appends only what changed since the previous save to the journal of the level file (see LevelJournal.h),
+         * instead of rewriting the whole file. Only what changed is encoded, compressed and written (finding what changed
+         * only hashes the persistent entities), so use this for frequent autosaves.
+         *
+         * Instead, the journal is compacted by saving the whole Level with `saveAsync()` if:
+         *  - the Level was not loaded from or saved to its file (in the current format) before,
+         *  - Rooms were added, deleted, or made (non-)persistent since then,
+         *  - the journal has become larger than `maxJournalSizeRatio` times the level file,
+         *  - or `journalCompactionInterval` seconds of Level time have passed since the previous compaction.
+         */
+        void saveIncremental();
+
+        /**
+         * Replaces only the section of Room `i` in the level file it was loaded from or saved to (see `rewriteRoomInLevelFile()`).
+         * Throws if that file does not describe the current Rooms, or if it has a journal: rewriting a section changes the
+         * level file, which makes its journal be ignored. Use `save()` in those cases.
+         */
+        void rewriteRoomInFile(int i, const level_file::CompressionSettings &compression = {});
+
+        float maxJournalSizeRatio = .5f;
+
+        // 0 means: only compact when needed.
+        double journalCompactionInterval = 600.0;
+
+        /**
+         * Used by `saveIncremental()` for the journal and by `deactivateRoom()`, where speed matters more than size.
+         * Compacting the journal rewrites the level file with the compression it was loaded or saved with instead.
+         */
+        level_file::CompressionSettings quickCompression { level_file::Compression::FastLz };
+
+        /**
+         * Blocks until the background save (if any) has finished, and calls `onSaved`.
+         */
+        void waitForSave();
+
+        /**
+         * Called on the thread that calls `update()` or `waitForSave()` when a background save has finished.
+         * The second argument is the error message if saving failed, or empty on success.
+         */
+        delegate<void(const std::string &, const std::string &)> onSaved;
 
         ~Level();
 
+      private:
+        void updateRooms(double deltaTime);
+
+        void continueLoadingRooms();
+
+        RoomSectionData readInactiveRoom(int i) const;
+
+        static void loadBinaryData(Room &, const RoomSectionData &);
+
+        LevelFileWriter snapshotForSave(const char *path, const level_file::CompressionSettings &compression);
+
+        bool shouldCompactJournal(const std::string &path) const;
+
+        void deactivateLeastRecentlyNeededRooms();
     };
 
     void to_json(json &j, const Level &lvl);
@@ -0,0 +1,557 @@
+#include "LevelFile.h"
+#include "CompressionCodec.h"
+
+#include <files/file_utils.h>
+#include <utils/gu_error.h>
+
+#include <zlib.h>
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+    using namespace dibidab::level;
+
+    constexpr std::streamoff INDEX_LOCATION_OFFSET = sizeof(level_file::MAGIC) + sizeof(uint32_t);
+
+    template<typename Type>
+    void writeValue(std::ostream &out, const Type &value)
+    {
+        out.write((const char *) &value, sizeof(Type));
+    }
+
+    template<typename Type>
+    Type readValue(std::istream &in, const std::string &path)
+    {
+        Type value;
+        if (!in.read((char *) &value, sizeof(Type)))
+        {
+            throw gu_err("Unexpected end of level file: " + path);
+        }
+        return value;
+    }
+
+    std::string indexToBytes(const std::vector<level_file::IndexEntry> &index)
+    {
+        std::ostringstream out;
+        writeValue(out, uint32_t(index.size()));
+        for (const level_file::IndexEntry &entry : index)
+        {
+            writeValue(out, entry.offset);
+            writeValue(out, entry.compressedSize);
+            writeValue(out, entry.uncompressedSize);
+            writeValue(out, uint8_t(entry.compression));
+            writeValue(out, entry.sectionVersion);
+            writeValue(out, uint16_t(entry.roomName.size()));
+            out.write(entry.roomName.data(), entry.roomName.size());
+        }
+        return out.str();
+    }
+
+    std::vector<level_file::IndexEntry> readIndex(std::istream &in, const std::string &path, uint32_t fileVersion)
+    {
+        std::vector<level_file::IndexEntry> index(readValue<uint32_t>(in, path));
+        for (level_file::IndexEntry &entry : index)
+        {
+            entry.offset = readValue<uint64_t>(in, path);
+            entry.compressedSize = readValue<uint64_t>(in, path);
+            entry.uncompressedSize = readValue<uint64_t>(in, path);
+            entry.compression = level_file::Compression(readValue<uint8_t>(in, path));
+            entry.sectionVersion = fileVersion >= 3 ? readValue<uint8_t>(in, path) : uint8_t(fileVersion);
+            entry.roomName.resize(readValue<uint16_t>(in, path));
+            if (!in.read(entry.roomName.data(), entry.roomName.size()))
+            {
+                throw gu_err("Unexpected end of level file: " + path);
+            }
+        }
+        return index;
+    }
+
+    /**
+     * Reads the header, and returns false if the file does not start with the magic of the current format.
+     */
+    bool readHeader(std::istream &in, const std::string &path, uint32_t &version, uint64_t &indexOffset, uint64_t &indexSize)
+    {
+        char magic[sizeof(level_file::MAGIC)];
+        if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, level_file::MAGIC, sizeof(magic)) != 0)
+        {
+            return false;
+        }
+        version = readValue<uint32_t>(in, path);
+        if (version < level_file::MIN_SUPPORTED_VERSION || version > level_file::VERSION)
+        {
+            throw gu_err("Level file " + path + " has unsupported version " + std::to_string(version));
+        }
+        indexOffset = readValue<uint64_t>(in, path);
+        indexSize = readValue<uint64_t>(in, path);
+        return true;
+    }
+
+    /**
+     * Returns the uncompressed section: the size of the CBOR data, the CBOR data, the size of the entity columns,
+     * the entity columns, and the binary data.
+     */
+    std::vector<unsigned char> roomToSection(const RoomSectionData &room)
+    {
+        std::vector<unsigned char> section(sizeof(uint64_t), 0u);
+        json::to_cbor(room.jsonData, section);
+        const uint64_t jsonSize = section.size() - sizeof(uint64_t);
+        std::memcpy(&section[0], &jsonSize, sizeof(uint64_t));
+
+        const uint64_t entityColumnsSize = room.entityColumns.size();
+        const auto *entityColumnsSizeBytes = (const unsigned char *) &entityColumnsSize;
+        section.insert(section.end(), entityColumnsSizeBytes, entityColumnsSizeBytes + sizeof(uint64_t));
+        section.insert(section.end(), room.entityColumns.begin(), room.entityColumns.end());
+
+        if (room.mappedBinaryData.file != nullptr)
+        {
+            section.insert(section.end(), room.mappedBinaryData.data, room.mappedBinaryData.data + room.mappedBinaryData.size);
+        }
+        else
+        {
+            section.insert(section.end(), room.binaryData.begin(), room.binaryData.end());
+        }
+        return section;
+    }
+
+    /**
+     * @param mappedFile If not nullptr, `section` is in this file, and the binary data will be a view into it instead of a copy.
+     */
+    RoomSectionData sectionToRoom(
+        const unsigned char *section,
+        uint64_t sectionSize,
+        const level_file::IndexEntry &entry,
+        const std::shared_ptr<const MappedFile> &mappedFile = nullptr
+    )
+    {
+        const std::string &roomName = entry.roomName;
+        if (sectionSize < sizeof(uint64_t))
+        {
+            throw gu_err("Section of room '" + roomName + "' is too small");
+        }
+        uint64_t jsonSize;
+        std::memcpy(&jsonSize, section, sizeof(uint64_t));
+
+        const uint64_t jsonEnd = sizeof(uint64_t) + jsonSize;
+        if (jsonEnd > sectionSize)
+        {
+            throw gu_err("Section of room '" + roomName + "' does not contain as much json data as described");
+        }
+        RoomSectionData room;
+        room.name = roomName;
+        room.jsonData = json::from_cbor(section + sizeof(uint64_t), section + jsonEnd);
+
+        uint64_t binaryBegin = jsonEnd;
+        if (entry.sectionVersion >= 3)
+        {
+            if (jsonEnd + sizeof(uint64_t) > sectionSize)
+            {
+                throw gu_err("Section of room '" + roomName + "' is too small");
+            }
+            uint64_t entityColumnsSize;
+            std::memcpy(&entityColumnsSize, section + jsonEnd, sizeof(uint64_t));
+            const uint64_t entityColumnsBegin = jsonEnd + sizeof(uint64_t);
+            binaryBegin = entityColumnsBegin + entityColumnsSize;
+            if (entityColumnsSize > sectionSize || binaryBegin > sectionSize)
+            {
+                throw gu_err("Section of room '" + roomName + "' does not contain as many entities as described");
+            }
+            room.entityColumns.assign(section + entityColumnsBegin, section + binaryBegin);
+        }
+        if (mappedFile != nullptr)
+        {
+            room.mappedBinaryData = { mappedFile, section + binaryBegin, sectionSize - binaryBegin };
+        }
+        else
+        {
+            room.binaryData.assign(section + binaryBegin, section + sectionSize);
+        }
+        return room;
+    }
+}
+
+dibidab::level::LevelFileReader::LevelFileReader(const char *path) :
+    path(path),
+    file(path, std::ios::binary)
+{
+    if (!file)
+    {
+        throw gu_err("Could not open level file: " + this->path);
+    }
+    uint64_t indexOffset, indexSize;
+    if (!readHeader(file, this->path, version, indexOffset, indexSize))
+    {
+        file.close();
+        version = 0;
+        readLegacyFormat();
+        return;
+    }
+    file.seekg(std::streamoff(indexOffset));
+    index = readIndex(file, this->path, version);
+
+    try
+    {
+        mappedFile = std::make_shared<const MappedFile>(path);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Reading level file without mapping it: " << e.what() << std::endl;
+    }
+}
+
+const std::string &dibidab::level::LevelFileReader::getPath() const
+{
+    return path;
+}
+
+bool dibidab::level::LevelFileReader::isLegacyFormat() const
+{
+    return bLegacyFormat;
+}
+
+uint32_t dibidab::level::LevelFileReader::getVersion() const
+{
+    return version;
+}
+
+int dibidab::level::LevelFileReader::getNrOfRooms() const
+{
+    return int(bLegacyFormat ? legacyRooms.size() : index.size());
+}
+
+const std::string &dibidab::level::LevelFileReader::getRoomName(int roomIndex) const
+{
+    if (roomIndex < 0 || roomIndex >= getNrOfRooms())
+    {
+        throw gu_err("Room index out of bounds");
+    }
+    return bLegacyFormat ? legacyRooms[roomIndex].name : index[roomIndex].roomName;
+}
+
+const dibidab::level::level_file::IndexEntry &dibidab::level::LevelFileReader::getIndexEntry(int roomIndex) const
+{
+    if (bLegacyFormat)
+    {
+        throw gu_err("Legacy level files have no index");
+    }
+    if (roomIndex < 0 || roomIndex >= getNrOfRooms())
+    {
+        throw gu_err("Room index out of bounds");
+    }
+    return index[roomIndex];
+}
+
+int dibidab::level::LevelFileReader::findRoomByName(const std::string &name) const
+{
+    for (int i = 0; i < getNrOfRooms(); i++)
+    {
+        if (getRoomName(i) == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+dibidab::level::RoomSectionData dibidab::level::LevelFileReader::readRoom(int roomIndex) const
+{
+    if (bLegacyFormat)
+    {
+        if (roomIndex < 0 || roomIndex >= getNrOfRooms())
+        {
+            throw gu_err("Room index out of bounds");
+        }
+        return legacyRooms[roomIndex];
+    }
+    if (roomIndex >= 0 && roomIndex < getNrOfRooms() && mappedFile != nullptr)
+    {
+        const level_file::IndexEntry &entry = index[roomIndex];
+        const unsigned char *section = getMappedSection(entry);
+        if (entry.compression == level_file::Compression::Store)
+        {
+            if (entry.compressedSize != entry.uncompressedSize)
+            {
+                throw gu_err("Uncompressed section of room '" + entry.roomName + "' has an invalid size");
+            }
+            return sectionToRoom(section, entry.uncompressedSize, entry, mappedFile);
+        }
+        return decompressRoom(entry, section, entry.compressedSize);
+    }
+    level_file::IndexEntry entry;
+    const std::vector<unsigned char> compressed = readCompressedRoom(roomIndex, entry);
+    return decompressRoom(entry, compressed);
+}
+
+const unsigned char *dibidab::level::LevelFileReader::getMappedSection(const level_file::IndexEntry &entry) const
+{
+    if (mappedFile == nullptr)
+    {
+        return nullptr;
+    }
+    if (entry.offset > mappedFile->getSize() || entry.compressedSize > mappedFile->getSize() - entry.offset)
+    {
+        throw gu_err("Section of room '" + entry.roomName + "' is outside of level file: " + path);
+    }
+    return mappedFile->getData() + entry.offset;
+}
+
+std::vector<unsigned char> dibidab::level::LevelFileReader::readCompressedRoom(int roomIndex, level_file::IndexEntry &entryOut) const
+{
+    if (roomIndex < 0 || roomIndex >= getNrOfRooms())
+    {
+        throw gu_err("Room index out of bounds");
+    }
+    if (bLegacyFormat)
+    {
+        // Legacy files were decompressed as a whole, so compress the Room again:
+        return compressRoom(legacyRooms[roomIndex], entryOut);
+    }
+    entryOut = index[roomIndex];
+
+    if (const unsigned char *section = getMappedSection(entryOut))
+    {
+        return std::vector<unsigned char>(section, section + entryOut.compressedSize);
+    }
+    std::vector<unsigned char> compressed(entryOut.compressedSize);
+    std::lock_guard<std::mutex> lock(fileMutex);
+    file.clear();
+    file.seekg(std::streamoff(entryOut.offset));
+    if (!file.read((char *) compressed.data(), compressed.size()))
+    {
+        throw gu_err("Unexpected end of level file " + path + " while reading room '" + entryOut.roomName + "'");
+    }
+    return compressed;
+}
+
+void dibidab::level::LevelFileReader::readLegacyFormat()
+{
+    typedef uint64_t level_data_length_type;
+
+    bLegacyFormat = true;
+
+    auto compressedData = fu::readBinary(path.c_str());
+    if (compressedData.size() <= sizeof(int))
+    {
+        throw gu_err("Level file does barely contain any data!");
+    }
+
+    unsigned long compressedDataSize = compressedData.size() - sizeof(int);
+
+    unsigned long originalDataSize = *((int *) &compressedData[compressedDataSize]);
+    unsigned long originalDataSize_ = originalDataSize;
+
+    std::vector<uint8_t> uncompressedData(originalDataSize);
+
+    int zResult = uncompress(&uncompressedData[0], &originalDataSize, &compressedData[0], compressedDataSize);
+
+    if (originalDataSize != originalDataSize_)
+    {
+        throw gu_err("Length of uncompressed data does not match length of original data");
+    }
+
+    if (zResult != Z_OK)
+    {
+        throw gu_err("Error while UNcompressing");
+    }
+
+    if (uncompressedData.size() <= sizeof(level_data_length_type))
+    {
+        throw gu_err("Level file does barely contain any data!");
+    }
+    const level_data_length_type jsonDataLength = *((level_data_length_type *) &uncompressedData[0]);
+
+    const level_data_length_type binaryBegin = sizeof(level_data_length_type) + jsonDataLength;
+
+    if (binaryBegin > uncompressedData.size())
+    {
+        throw gu_err("Level file does not contain as much json data as described!");
+    }
+
+    json j = json::from_cbor(
+        &uncompressedData[sizeof(level_data_length_type)],
+        &uncompressedData[binaryBegin]
+    );
+    for (json &roomJson : j.at("rooms"))
+    {
+        RoomSectionData &room = legacyRooms.emplace_back();
+        room.name = roomJson.value("name", "");
+        room.jsonData = std::move(roomJson);
+    }
+
+    level_data_length_type nextRoomBinaryBegin = binaryBegin;
+    for (RoomSectionData &room : legacyRooms)
+    {
+        if (nextRoomBinaryBegin + sizeof(level_data_length_type) >= uncompressedData.size())
+        {
+            break;
+        }
+        const level_data_length_type roomBinaryBegin = nextRoomBinaryBegin;
+        const level_data_length_type roomBinaryDataLength = *((level_data_length_type *) &uncompressedData[roomBinaryBegin]);
+        nextRoomBinaryBegin += roomBinaryDataLength + sizeof(level_data_length_type);
+        if (nextRoomBinaryBegin > uncompressedData.size())
+        {
+            throw gu_err("Level file does not contain as much binary room data as described for room '" + room.name + "'");
+        }
+        const auto roomBinaryData = uncompressedData.begin() + roomBinaryBegin + sizeof(level_data_length_type);
+        room.binaryData.assign(roomBinaryData, roomBinaryData + roomBinaryDataLength);
+    }
+}
+
+void dibidab::level::LevelFileWriter::addRoom(RoomSectionData room)
+{
+    sections.emplace_back().toCompress = std::move(room);
+}
+
+dibidab::level::LevelFileWriter::LevelFileWriter(const level_file::CompressionSettings &compression) :
+    compression(compression)
+{
+}
+
+void dibidab::level::LevelFileWriter::addCompressedRoom(const level_file::IndexEntry &entry, std::vector<unsigned char> compressed)
+{
+    Section &section = sections.emplace_back();
+    section.entry = entry;
+    section.compressed = std::move(compressed);
+}
+
+std::vector<unsigned char> dibidab::level::compressRoom(
+    const RoomSectionData &room,
+    level_file::IndexEntry &entryOut,
+    const level_file::CompressionSettings &compression
+)
+{
+    const std::vector<unsigned char> section = roomToSection(room);
+    std::vector<unsigned char> compressed = getCompressionCodec(compression.compression).compress(
+        section.data(), section.size(), compression.level
+    );
+    entryOut.roomName = room.name;
+    entryOut.compressedSize = compressed.size();
+    entryOut.uncompressedSize = section.size();
+    entryOut.compression = compression.compression;
+    entryOut.sectionVersion = level_file::VERSION;
+    return compressed;
+}
+
+dibidab::level::RoomSectionData dibidab::level::decompressRoom(
+    const level_file::IndexEntry &entry,
+    const std::vector<unsigned char> &compressed
+)
+{
+    return decompressRoom(entry, compressed.data(), compressed.size());
+}
+
+dibidab::level::RoomSectionData dibidab::level::decompressRoom(
+    const level_file::IndexEntry &entry,
+    const unsigned char *compressed,
+    uint64_t compressedSize
+)
+{
+    const CompressionCodec *codec;
+    try
+    {
+        codec = &getCompressionCodec(entry.compression);
+    }
+    catch (std::exception &e)
+    {
+        throw gu_err("Cannot decompress room '" + entry.roomName + "': " + e.what());
+    }
+    std::vector<unsigned char> section(entry.uncompressedSize);
+    if (!codec->decompress(compressed, compressedSize, section.data(), section.size()))
+    {
+        throw gu_err("Error while decompressing room '" + entry.roomName + "'");
+    }
+    return sectionToRoom(section.data(), section.size(), entry);
+}
+
+void dibidab::level::LevelFileWriter::write(const char *path)
+{
+    std::vector<level_file::IndexEntry> index;
+
+    uint64_t offset = INDEX_LOCATION_OFFSET + 2 * sizeof(uint64_t);
+    for (Section &section : sections)
+    {
+        if (!section.toCompress.has_value() && compression.bRecompressAll)
+        {
+            section.toCompress = decompressRoom(section.entry, section.compressed);
+        }
+        if (section.toCompress.has_value())
+        {
+            section.compressed = compressRoom(*section.toCompress, section.entry, compression);
+            section.toCompress.reset();
+        }
+        section.entry.offset = offset;
+        offset += section.entry.compressedSize;
+        index.push_back(section.entry);
+    }
+    const std::string indexBytes = indexToBytes(index);
+
+    const std::string tempPath = std::string(path) + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            throw gu_err("Could not open " + tempPath + " for writing");
+        }
+        out.write(level_file::MAGIC, sizeof(level_file::MAGIC));
+        writeValue(out, level_file::VERSION);
+        writeValue(out, offset);
+        writeValue(out, uint64_t(indexBytes.size()));
+
+        for (const Section &section : sections)
+        {
+            out.write((const char *) section.compressed.data(), section.compressed.size());
+        }
+        out.write(indexBytes.data(), indexBytes.size());
+
+        if (!out.flush())
+        {
+            throw gu_err("Error while writing level file " + tempPath);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error)
+    {
+        throw gu_err("Could not replace " + std::string(path) + " with " + tempPath + ": " + error.message());
+    }
+}
+
+void dibidab::level::rewriteRoomInLevelFile(
+    const char *path,
+    int indexInFile,
+    const RoomSectionData &room,
+    const level_file::CompressionSettings &compression
+)
+{
+    level_file::CompressionSettings newSectionCompression = compression;
+    newSectionCompression.bRecompressAll = false;
+    LevelFileWriter writer(newSectionCompression);
+    {
+        // The reader maps the file, so it has to be closed before the file is replaced:
+        const LevelFileReader reader(path);
+        if (reader.isLegacyFormat())
+        {
+            throw gu_err("Cannot rewrite a single room of " + std::string(path) + ", it uses the legacy level format. Save the whole Level instead.");
+        }
+        if (indexInFile < 0 || indexInFile >= reader.getNrOfRooms())
+        {
+            throw gu_err("Room index out of bounds");
+        }
+        for (int i = 0; i < reader.getNrOfRooms(); i++)
+        {
+            if (i == indexInFile)
+            {
+                writer.addRoom(room);
+                continue;
+            }
+            // The sections of an older version keep their own section version:
+            level_file::IndexEntry entry;
+            std::vector<unsigned char> compressed = reader.readCompressedRoom(i, entry);
+            writer.addCompressedRoom(entry, std::move(compressed));
+        }
+    }
+    writer.write(path);
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <json.hpp>
+#include <entt/entity/entity.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dibidab::level
+{
+    /**
+     * Changes to the persistent entities of a Room since its section was written. See `LevelJournal.h`.
+     */
+    struct EntityDelta
+    {
+        // By entity hint:
+        std::vector<entt::entity> destroyedEntities;
+        // New and changed entities, these replace the saved entities with the same hint:
+        std::vector<unsigned char> entityColumns;
+    };
+
+    /**
+     * The saved data of one Room. See `Room::exportJsonData()`, `EntityColumnsWriter` and `Room::exportBinaryData()`.
+     */
+    struct RoomSectionData
+    {
+        std::string name;
+        json jsonData;
+        // The persistent entities, empty for sections written before version 3 (those have the entities in `jsonData`):
+        std::vector<unsigned char> entityColumns;
+        std::vector<unsigned char> binaryData;
+        // Set instead of `binaryData` if the section is stored uncompressed in a mapped level file, see `LevelFileReader::readRoom()`:
+        MappedBytes mappedBinaryData;
+        // Applied on top of `entityColumns` in order, see `applyJournalRecord()`:
+        std::vector<EntityDelta> entityDeltas;
+    };
+
+    /**
+     * Level files start with a header that points to an index. The index describes a separately compressed section per Room.
+     * This allows a single Room to be read, decompressed, rewritten or skipped without processing the other Rooms.
+     *
+     * Layout (native byte order):
+     *
+     *  Header:
+     *      char[4]     "DBLV"
+     *      uint32      version
+     *      uint64      offset of the index
+     *      uint64      size of the index
+     *  Room sections, at the offsets stored in the index.
+     *      Uncompressed, a section contains: uint64 size of the CBOR JSON data, CBOR JSON data,
+     *      uint64 size of the entity columns, entity columns (see `EntityColumns.h`), binary data.
+     *      Sections of version 2 do not have the entity columns.
+     *  Index:
+     *      uint32      number of Rooms
+     *      For each Room:
+     *          uint64  offset of its section
+     *          uint64  compressed size
+     *          uint64  uncompressed size
+     *          uint8   compression (see `level_file::Compression` and `CompressionCodec.h`)
+     *          uint8   section version (not present in version 2 files, where all sections are version 2)
+     *          uint16  name length, followed by the name
+     *
+     * Rewriting a Room appends its new section and a new index to the file, and then points the header to the new index.
+     * The space used by the old section is reclaimed the next time the whole Level is saved.
+     */
+    namespace level_file
+    {
+        constexpr char MAGIC[4] = { 'D', 'B', 'L', 'V' };
+        constexpr uint32_t VERSION = 3;
+        constexpr uint32_t MIN_SUPPORTED_VERSION = 2;
+
+        enum class Compression : uint8_t
+        {
+            Zlib = 0,
+            Store = 1,  // Not compressed.
+            FastLz = 2  // Larger than zlib, but much faster. Meant for quicksaves and deactivated Rooms.
+        };
+
+        struct CompressionSettings
+        {
+            Compression compression = Compression::Zlib;
+            // Codec specific, for zlib from 0 (fastest) to 9 (smallest). -1 is the codec's default:
+            int level = -1;
+            // If true, sections that were compressed before (inactive Rooms for example) are compressed again with these settings:
+            bool bRecompressAll = false;
+        };
+
+        struct IndexEntry
+        {
+            std::string roomName;
+            uint64_t offset = 0;
+            uint64_t compressedSize = 0;
+            uint64_t uncompressedSize = 0;
+            Compression compression = Compression::Zlib;
+            uint8_t sectionVersion = VERSION;
+        };
+    }
+
+    /**
+     * Reads level files written by `LevelFileWriter`.
+     * Files in the legacy format (one compressed buffer with the JSON of all Rooms followed by their binary data)
+     * can be read too, but those have to be decompressed completely when opened.
+     *
+     * Other files are mapped into memory if possible, so that sections are read without copying them first.
+     */
+    class LevelFileReader
+    {
+      public:
+        explicit LevelFileReader(const char *path);
+
+        const std::string &getPath() const;
+
+        bool isLegacyFormat() const;
+
+        /**
+         * 0 for the legacy format.
+         */
+        uint32_t getVersion() const;
+
+        int getNrOfRooms() const;
+
+        const std::string &getRoomName(int roomIndex) const;
+
+        /**
+         * Throws for the legacy format, which has no index.
+         */
+        const level_file::IndexEntry &getIndexEntry(int roomIndex) const;
+
+        /**
+         * Returns -1 if there is no Room with that name.
+         */
+        int findRoomByName(const std::string &name) const;
+
+        /**
+         * Reads and decompresses the section of only this Room. Can be called from multiple threads at the same time.
+         * The binary data of sections stored without compression (`level_file::Compression::Store`) in a mapped file
+         * is not copied, but returned as `RoomSectionData::mappedBinaryData`.
+         */
+        RoomSectionData readRoom(int roomIndex) const;
+
+        /**
+         * Reads the section of this Room without decompressing it. See `decompressRoom()`.
+         */
+        std::vector<unsigned char> readCompressedRoom(int roomIndex, level_file::IndexEntry &entryOut) const;
+
+      private:
+        void readLegacyFormat();
+
+        /**
+         * Returns the section in `mappedFile`, or nullptr if the file is not mapped.
+         */
+        const unsigned char *getMappedSection(const level_file::IndexEntry &) const;
+
+        std::string path;
+        std::vector<level_file::IndexEntry> index;
+
+        std::shared_ptr<const MappedFile> mappedFile;
+
+        mutable std::mutex fileMutex;
+        mutable std::ifstream file;
+
+        uint32_t version = 0;
+        bool bLegacyFormat = false;
+        std::vector<RoomSectionData> legacyRooms;
+    };
+
+    /**
+     * Writes the Rooms added to it to a level file, see `LevelFileReader` for the layout.
+     */
+    class LevelFileWriter
+    {
+      public:
+        explicit LevelFileWriter(const level_file::CompressionSettings &compression = {});
+
+        /**
+         * The Room is encoded and compressed by `write()`, so that can be done on another thread.
+         */
+        void addRoom(RoomSectionData room);
+
+        /**
+         * Adds a Room that was already compressed by `compressRoom()` or read by `LevelFileReader::readCompressedRoom()`.
+         */
+        void addCompressedRoom(const level_file::IndexEntry &entry, std::vector<unsigned char> compressed);
+
+        /**
+         * Compresses the Rooms that were not compressed yet, and writes the file.
+         * The file is written to a temporary file first, which then replaces `path`, so that `path` is never left half-written.
+         */
+        void write(const char *path);
+
+      private:
+        level_file::CompressionSettings compression;
+
+
+        struct Section
+        {
+            level_file::IndexEntry entry;
+            std::vector<unsigned char> compressed;
+            std::optional<RoomSectionData> toCompress;
+        };
+        std::vector<Section> sections;
+    };
+
+    /**
+     * Returns the compressed section of the Room, and fills in the sizes, compression and name of `entryOut`.
+     */
+    std::vector<unsigned char> compressRoom(
+        const RoomSectionData &room, level_file::IndexEntry &entryOut, const level_file::CompressionSettings &compression = {}
+    );
+
+    RoomSectionData decompressRoom(const level_file::IndexEntry &entry, const std::vector<unsigned char> &compressed);
+
+    RoomSectionData decompressRoom(const level_file::IndexEntry &entry, const unsigned char *compressed, uint64_t compressedSize);
+
+    /**
+     * Replaces the section of one Room in an existing level file, without decompressing the other Rooms.
+     * Like `LevelFileWriter::write()`, a new file is written and then renamed, so the file is never changed while it is
+     * still mapped by a `LevelFileReader`. Readers of the old file should be closed first on platforms that cannot
+     * replace opened files (see `Level::rewriteRoomInFile()`).
+     * Throws if the file is in the legacy format.
+     *
+     * @param indexInFile Index of the section in the file. This is not the index of the Room in its Level,
+     *                    because non-persistent Rooms are not saved. Use `Level::rewriteRoomInFile()` for Rooms of a Level.
+     */
+    void rewriteRoomInLevelFile(
+        const char *path, int indexInFile, const RoomSectionData &room, const level_file::CompressionSettings &compression = {}
+    );
+}
@@ -0,0 +1,252 @@
+#include "LevelJournal.h"
+
+#include <utils/gu_error.h>
+
+#include <zlib.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    using namespace dibidab::level;
+
+    struct LevelFileIdentity
+    {
+        uint64_t size = 0;
+        uint32_t checksum = 0;
+
+        bool operator==(const LevelFileIdentity &other) const
+        {
+            return size == other.size && checksum == other.checksum;
+        }
+    };
+
+    template<typename Type>
+    void writeValue(std::ostream &out, const Type &value)
+    {
+        out.write((const char *) &value, sizeof(Type));
+    }
+
+    template<typename Type>
+    bool readValue(std::istream &in, Type &value)
+    {
+        return bool(in.read((char *) &value, sizeof(Type)));
+    }
+
+    /**
+     * The size of the level file, and a checksum of its header and index.
+     * The index contains the offsets and sizes of all sections, so it changes whenever the file is written.
+     */
+    bool getLevelFileIdentity(const char *levelFilePath, LevelFileIdentity &identityOut)
+    {
+        std::ifstream file(levelFilePath, std::ios::binary);
+        std::vector<char> header(sizeof(level_file::MAGIC) + sizeof(uint32_t) + 2 * sizeof(uint64_t));
+        if (!file || !file.read(header.data(), header.size())
+            || std::memcmp(header.data(), level_file::MAGIC, sizeof(level_file::MAGIC)) != 0)
+        {
+            return false;
+        }
+        uint64_t indexOffset, indexSize;
+        std::memcpy(&indexOffset, &header[sizeof(level_file::MAGIC) + sizeof(uint32_t)], sizeof(uint64_t));
+        std::memcpy(&indexSize, &header[sizeof(level_file::MAGIC) + sizeof(uint32_t) + sizeof(uint64_t)], sizeof(uint64_t));
+
+        std::vector<char> index(indexSize);
+        file.seekg(std::streamoff(indexOffset));
+        if (!file.read(index.data(), index.size()))
+        {
+            return false;
+        }
+        uLong checksum = crc32(0L, Z_NULL, 0);
+        checksum = crc32(checksum, (const Bytef *) header.data(), uInt(header.size()));
+        checksum = crc32(checksum, (const Bytef *) index.data(), uInt(index.size()));
+
+        std::error_code error;
+        identityOut.size = std::filesystem::file_size(levelFilePath, error);
+        identityOut.checksum = uint32_t(checksum);
+        return !error;
+    }
+
+    /**
+     * Returns false if the journal does not exist or belongs to another level file.
+     */
+    bool readHeader(std::istream &in, const LevelFileIdentity &levelFileIdentity)
+    {
+        char magic[sizeof(level_journal::MAGIC)];
+        uint32_t version;
+        LevelFileIdentity identity;
+        if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, level_journal::MAGIC, sizeof(magic)) != 0
+            || !readValue(in, version) || !readValue(in, identity.size) || !readValue(in, identity.checksum))
+        {
+            return false;
+        }
+        if (version != level_journal::VERSION)
+        {
+            std::cerr << "Ignoring level journal with unsupported version " << version << std::endl;
+            return false;
+        }
+        return identity == levelFileIdentity;
+    }
+
+    /**
+     * Reads records until the end of the journal or until an invalid record, and returns where the last valid record ends.
+     */
+    std::streamoff readRecords(std::istream &in, uint64_t journalSize, std::vector<JournalRecord> *recordsOut)
+    {
+        std::streamoff validEnd = in.tellg();
+        while (true)
+        {
+            JournalRecord record;
+            uint32_t roomIndex, nrOfDestroyedEntities, checksum;
+            uint8_t type, compression, sectionVersion;
+            if (!readValue(in, roomIndex) || !readValue(in, type) || type > uint8_t(JournalRecord::Type::Room)
+                || !readValue(in, nrOfDestroyedEntities) || nrOfDestroyedEntities * uint64_t(sizeof(entt::entity)) > journalSize)
+            {
+                break;
+            }
+            record.roomIndex = int(roomIndex);
+            record.type = JournalRecord::Type(type);
+            record.destroyedEntities.resize(nrOfDestroyedEntities);
+            if (!in.read((char *) record.destroyedEntities.data(), record.destroyedEntities.size() * sizeof(entt::entity))
+                || !readValue(in, compression) || !readValue(in, sectionVersion)
+                || !readValue(in, record.entry.compressedSize) || !readValue(in, record.entry.uncompressedSize)
+                || !readValue(in, checksum))
+            {
+                break;
+            }
+            if (record.entry.compressedSize > journalSize)
+            {
+                break;
+            }
+            record.entry.compression = level_file::Compression(compression);
+            record.entry.sectionVersion = sectionVersion;
+            record.compressed.resize(record.entry.compressedSize);
+            if (!in.read((char *) record.compressed.data(), record.compressed.size())
+                || crc32(crc32(0L, Z_NULL, 0), record.compressed.data(), uInt(record.compressed.size())) != checksum)
+            {
+                break;
+            }
+            validEnd = in.tellg();
+            if (recordsOut != nullptr)
+            {
+                recordsOut->push_back(std::move(record));
+            }
+        }
+        return validEnd;
+    }
+}
+
+std::string dibidab::level::getJournalPath(const char *levelFilePath)
+{
+    return std::string(levelFilePath) + ".journal";
+}
+
+std::vector<dibidab::level::JournalRecord> dibidab::level::readLevelJournal(const char *levelFilePath, uint64_t *validEndOut)
+{
+    std::vector<JournalRecord> records;
+    if (validEndOut != nullptr)
+    {
+        *validEndOut = 0;
+    }
+
+    std::ifstream in(getJournalPath(levelFilePath), std::ios::binary);
+    LevelFileIdentity levelFileIdentity;
+    if (!in || !getLevelFileIdentity(levelFilePath, levelFileIdentity))
+    {
+        return records;
+    }
+    if (!readHeader(in, levelFileIdentity))
+    {
+        std::cerr << "Ignoring journal of " << levelFilePath << ", it belongs to another version of the level file" << std::endl;
+        return records;
+    }
+    const std::streamoff validEnd = readRecords(in, std::filesystem::file_size(getJournalPath(levelFilePath)), &records);
+    if (validEndOut != nullptr && !records.empty())
+    {
+        *validEndOut = uint64_t(validEnd);
+    }
+    return records;
+}
+
+uint64_t dibidab::level::appendToLevelJournal(const char *levelFilePath, uint64_t validEnd, const std::vector<JournalRecord> &records)
+{
+    const std::string journalPath = getJournalPath(levelFilePath);
+
+    LevelFileIdentity levelFileIdentity;
+    if (validEnd == 0 && !getLevelFileIdentity(levelFilePath, levelFileIdentity))
+    {
+        throw gu_err("Cannot create the journal of " + std::string(levelFilePath) + ", it is not a valid level file");
+    }
+    if (validEnd > 0)
+    {
+        // Continue after the last valid record, so that a record that was cut off does not hide the records after it:
+        std::error_code error;
+        std::filesystem::resize_file(journalPath, validEnd, error);
+        if (error)
+        {
+            throw gu_err("Could not append to " + journalPath + ": " + error.message());
+        }
+    }
+
+    std::ofstream out(journalPath, std::ios::binary | (validEnd > 0 ? std::ios::app : std::ios::trunc));
+    if (!out)
+    {
+        throw gu_err("Could not open " + journalPath + " for writing");
+    }
+    uint64_t end = validEnd;
+    if (validEnd == 0)
+    {
+        out.write(level_journal::MAGIC, sizeof(level_journal::MAGIC));
+        writeValue(out, level_journal::VERSION);
+        writeValue(out, levelFileIdentity.size);
+        writeValue(out, levelFileIdentity.checksum);
+        end += sizeof(level_journal::MAGIC) + sizeof(level_journal::VERSION) + sizeof(levelFileIdentity.size) + sizeof(levelFileIdentity.checksum);
+    }
+    for (const JournalRecord &record : records)
+    {
+        writeValue(out, uint32_t(record.roomIndex));
+        writeValue(out, uint8_t(record.type));
+        writeValue(out, uint32_t(record.destroyedEntities.size()));
+        out.write((const char *) record.destroyedEntities.data(), record.destroyedEntities.size() * sizeof(entt::entity));
+        writeValue(out, uint8_t(record.entry.compression));
+        writeValue(out, record.entry.sectionVersion);
+        writeValue(out, record.entry.compressedSize);
+        writeValue(out, record.entry.uncompressedSize);
+        writeValue(out, uint32_t(crc32(crc32(0L, Z_NULL, 0), record.compressed.data(), uInt(record.compressed.size()))));
+        out.write((const char *) record.compressed.data(), record.compressed.size());
+        end += sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t) + record.destroyedEntities.size() * sizeof(entt::entity)
+            + 2 * sizeof(uint8_t) + 2 * sizeof(uint64_t) + sizeof(uint32_t) + record.compressed.size();
+    }
+    if (!out.flush())
+    {
+        throw gu_err("Error while writing " + journalPath);
+    }
+    return end;
+}
+
+void dibidab::level::deleteLevelJournal(const char *levelFilePath)
+{
+    std::error_code error;
+    std::filesystem::remove(getJournalPath(levelFilePath), error);
+}
+
+void dibidab::level::applyJournalRecord(RoomSectionData &room, const JournalRecord &record)
+{
+    RoomSectionData recordData = decompressRoom(record.entry, record.compressed);
+    recordData.name = room.name;
+    if (record.type == JournalRecord::Type::Room)
+    {
+        room = std::move(recordData);
+        return;
+    }
+    // The Json and binary data of the Room are always saved as a whole:
+    room.jsonData = std::move(recordData.jsonData);
+    room.binaryData = std::move(recordData.binaryData);
+    room.mappedBinaryData = {};
+
+    EntityDelta &delta = room.entityDeltas.emplace_back();
+    delta.destroyedEntities = record.destroyedEntities;
+    delta.entityColumns = std::move(recordData.entityColumns);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "LevelFile.h"
+
+namespace dibidab::level
+{
+    /**
+     * The journal of a level file (`<level file>.journal`) contains the changes to its Rooms since the level file was written.
+     * Incremental saves (`Level::saveIncremental()`) only append to the journal, saving the whole Level deletes it.
+     *
+     * Layout (native byte order):
+     *
+     *  Header:
+     *      char[4]     "DBJN"
+     *      uint32      version
+     *      uint64      size of the level file the journal belongs to
+     *      uint32      CRC-32 of the header and index of that level file
+     *  Records, until the end of the file:
+     *      uint32      index of the Room in the level file
+     *      uint8       type (see `JournalRecord::Type`)
+     *      uint32      number of destroyed entities, followed by their hints (uint32 each)
+     *      uint8       compression, uint8 section version, uint64 compressed size, uint64 uncompressed size
+     *      uint32      CRC-32 of the compressed section
+     *      The compressed section, see `LevelFileReader`.
+     *
+     * The journal is ignored if it belongs to another level file, for example if the game stopped after the level file was replaced,
+     * but before the journal was deleted. A record that is cut off or has an invalid CRC-32 ends the journal.
+     */
+    namespace level_journal
+    {
+        constexpr char MAGIC[4] = { 'D', 'B', 'J', 'N' };
+        constexpr uint32_t VERSION = 1;
+    }
+
+    struct JournalRecord
+    {
+        enum class Type : uint8_t
+        {
+            Delta = 0,  // The section only contains the new and changed entities. Destroyed entities are listed in the record.
+            Room = 1    // The section replaces the whole Room.
+        };
+
+        int roomIndex = -1;
+        Type type = Type::Delta;
+        std::vector<entt::entity> destroyedEntities;
+        level_file::IndexEntry entry;
+        std::vector<unsigned char> compressed;
+    };
+
+    std::string getJournalPath(const char *levelFilePath);
+
+    /**
+     * Returns the records of the journal that belongs to the level file, oldest first.
+     * Returns none if there is no journal, or if it belongs to another level file.
+     * @param validEndOut If not nullptr, set to where the last valid record ends, or to 0 if there are no records.
+     */
+    std::vector<JournalRecord> readLevelJournal(const char *levelFilePath, uint64_t *validEndOut = nullptr);
+
+    /**
+     * Appends the records to the journal of the level file, without reading what is in the journal already.
+     * @param validEnd Where the last valid record of the journal ends: as returned by `readLevelJournal()` or by the previous append.
+     *                 Anything after it (a record that was cut off) is overwritten. 0 creates a new journal.
+     * Returns where the appended records end, which is the size of the journal afterwards.
+     */
+    uint64_t appendToLevelJournal(const char *levelFilePath, uint64_t validEnd, const std::vector<JournalRecord> &records);
+
+    void deleteLevelJournal(const char *levelFilePath);
+
+    /**
+     * Decompresses the record and applies it to the saved data of its Room.
+     */
+    void applyJournalRecord(RoomSectionData &room, const JournalRecord &record);
+}
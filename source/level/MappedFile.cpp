@@ -0,0 +1,109 @@
+#include "MappedFile.h"
+
+#include <utils/gu_error.h>
+
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+dibidab::level::MappedFile::MappedFile(const char *path)
+{
+    fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        fileHandle = nullptr;
+        throw gu_err("Could not open " + std::string(path) + " for mapping");
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
+    {
+        CloseHandle(fileHandle);
+        throw gu_err("Could not get the size of " + std::string(path));
+    }
+    size = uint64_t(fileSize.QuadPart);
+    if (size == 0)
+    {
+        return;
+    }
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle != nullptr)
+    {
+        data = (const unsigned char *) MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (data == nullptr)
+    {
+        if (mappingHandle != nullptr)
+        {
+            CloseHandle(mappingHandle);
+        }
+        CloseHandle(fileHandle);
+        throw gu_err("Could not map " + std::string(path));
+    }
+}
+
+dibidab::level::MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mappingHandle != nullptr)
+    {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != nullptr)
+    {
+        CloseHandle(fileHandle);
+    }
+}
+
+#else
+
+dibidab::level::MappedFile::MappedFile(const char *path)
+{
+    const int fileDescriptor = open(path, O_RDONLY);
+    if (fileDescriptor < 0)
+    {
+        throw gu_err("Could not open " + std::string(path) + " for mapping");
+    }
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0)
+    {
+        close(fileDescriptor);
+        throw gu_err("Could not get the size of " + std::string(path));
+    }
+    size = uint64_t(fileStat.st_size);
+    if (size > 0)
+    {
+        void *mapped = mmap(nullptr, size_t(size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close(fileDescriptor);
+            throw gu_err("Could not map " + std::string(path));
+        }
+        data = (const unsigned char *) mapped;
+    }
+    // The mapping stays valid after closing the file:
+    close(fileDescriptor);
+}
+
+dibidab::level::MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+    {
+        munmap((void *) data, size_t(size));
+    }
+}
+
+#endif
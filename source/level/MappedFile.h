@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+namespace dibidab::level
+{
+    /**
+     * A file that is mapped into memory read-only, so that it can be read without copying it.
+     * The file should not be changed while it is mapped, except for appending to it.
+     *
+     * On Windows a mapped file cannot be replaced, so Levels cannot be saved to a file that is still mapped there.
+     */
+    class MappedFile
+    {
+      public:
+        /**
+         * Throws if the file cannot be opened or mapped.
+         */
+        explicit MappedFile(const char *path);
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        /**
+         * nullptr if the file is empty.
+         */
+        const unsigned char *getData() const
+        { return data; }
+
+        uint64_t getSize() const
+        { return size; }
+
+        ~MappedFile();
+
+      private:
+        const unsigned char *data = nullptr;
+        uint64_t size = 0;
+#ifdef _WIN32
+        void *fileHandle = nullptr;
+        void *mappingHandle = nullptr;
+#endif
+    };
+
+    /**
+     * A view into a MappedFile, which keeps the file mapped for as long as the view exists.
+     */
+    struct MappedBytes
+    {
+        std::shared_ptr<const MappedFile> file;
+        const unsigned char *data = nullptr;
+        uint64_t size = 0;
+    };
+}
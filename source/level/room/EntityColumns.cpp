@@ -0,0 +1,531 @@
+#include "EntityColumns.h"
+
+#include "../../ecs/components/Persistent.dibidab.h"
+#include "../../reflection/ComponentInfo.h"
+#include "../../reflection/StructInfo.h"
+
+#include <utils/gu_error.h>
+
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <set>
+
+namespace
+{
+    using namespace dibidab::level;
+
+    template<typename Type>
+    void appendValue(std::vector<unsigned char> &out, const Type &value)
+    {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(Type));
+    }
+
+    template<typename Type>
+    void appendValues(std::vector<unsigned char> &out, const std::vector<Type> &values)
+    {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(values.data());
+        out.insert(out.end(), bytes, bytes + values.size() * sizeof(Type));
+    }
+
+    void appendCbor(std::vector<unsigned char> &out, const json &j)
+    {
+        const size_t sizeOffset = out.size();
+        appendValue(out, uint64_t(0));
+        json::to_cbor(j, out);
+        const uint64_t cborSize = out.size() - sizeOffset - sizeof(uint64_t);
+        std::memcpy(&out[sizeOffset], &cborSize, sizeof(uint64_t));
+    }
+
+    /**
+     * Warns only once per component, because Rooms are saved often.
+     */
+    void warnAboutSavedComponent(const std::string &componentName, const char *problem)
+    {
+        static std::mutex mutex;
+        static std::set<std::string> warnedComponents;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (warnedComponents.insert(componentName).second)
+        {
+            std::cerr << "Saving persistent component " << componentName << ": " << problem << std::endl;
+        }
+    }
+
+    constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+    constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    // FNV-1a:
+    uint64_t hashBytes(uint64_t hash, const unsigned char *bytes, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ uint64_t(bytes[i])) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+    template<typename Type>
+    uint64_t hashValue(uint64_t hash, const Type &value)
+    {
+        return hashBytes(hash, reinterpret_cast<const unsigned char *>(&value), sizeof(Type));
+    }
+
+    uint64_t hashString(uint64_t hash, const char *str)
+    {
+        // Including the terminator, so that "ab" + "c" does not hash the same as "a" + "bc":
+        return hashBytes(hash, reinterpret_cast<const unsigned char *>(str), std::strlen(str) + 1);
+    }
+
+    class Cursor
+    {
+      public:
+        Cursor(const unsigned char *data, size_t size) : data(data), size(size)
+        {}
+
+        const unsigned char *skip(uint64_t nrOfBytes)
+        {
+            if (nrOfBytes > size - position)
+            {
+                throw gu_err("Unexpected end of entity columns");
+            }
+            const unsigned char *begin = data + position;
+            position += nrOfBytes;
+            return begin;
+        }
+
+        template<typename Type>
+        Type read()
+        {
+            Type value;
+            std::memcpy(&value, skip(sizeof(Type)), sizeof(Type));
+            return value;
+        }
+
+        template<typename Type>
+        std::vector<Type> readValues(uint32_t nrOfValues)
+        {
+            std::vector<Type> values(nrOfValues);
+            std::memcpy(values.data(), skip(uint64_t(nrOfValues) * sizeof(Type)), values.size() * sizeof(Type));
+            return values;
+        }
+
+        json readCbor()
+        {
+            const uint64_t cborSize = read<uint64_t>();
+            const unsigned char *cbor = skip(cborSize);
+            return json::from_cbor(cbor, cbor + cborSize);
+        }
+
+      private:
+        const unsigned char *data;
+        size_t size;
+        size_t position = 0;
+    };
+}
+
+uint64_t dibidab::level::entity_columns::getLayoutHash(const ComponentInfo &info)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    if (const StructInfo *structInfo = findStructInfo(info.structId))
+    {
+        for (const VariableInfo &variable : structInfo->variables)
+        {
+            hash = hashString(hash, variable.name);
+            hash = hashString(hash, variable.typeName);
+        }
+    }
+    else
+    {
+        hash = hashString(hash, info.name);
+    }
+    return hashValue(hash, uint64_t(info.binarySize));
+}
+
+uint64_t dibidab::level::EntityColumnsWriter::addEntity(
+    entt::entity entity,
+    const ecs::Persistent &persistent,
+    const char *name,
+    const entt::registry &registry
+)
+{
+    return visitEntity(this, entity, persistent, name, registry);
+}
+
+uint64_t dibidab::level::EntityColumnsWriter::getEntityHash(
+    entt::entity entity,
+    const ecs::Persistent &persistent,
+    const char *name,
+    const entt::registry &registry
+)
+{
+    return visitEntity(nullptr, entity, persistent, name, registry);
+}
+
+uint64_t dibidab::level::EntityColumnsWriter::visitEntity(
+    EntityColumnsWriter *writer,
+    entt::entity entity,
+    const ecs::Persistent &persistent,
+    const char *name,
+    const entt::registry &registry
+)
+{
+    const char *savedName = persistent.bSaveName ? name : nullptr;
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = hashString(hash, persistent.applyTemplateOnLoad.c_str());
+    hash = hashString(hash, savedName != nullptr ? savedName : "");
+    hash = hashValue(hash, savedName != nullptr);
+    hash = hashValue(hash, uint64_t(std::hash<json>()(persistent.data)));
+
+    const uint32_t row = writer != nullptr ? uint32_t(writer->hints.size()) : 0u;
+    if (writer != nullptr)
+    {
+        writer->hints.push_back(persistent.entityHint);
+        writer->templates.push_back(writer->getStringIndex(persistent.applyTemplateOnLoad));
+        writer->names.push_back(savedName != nullptr ? writer->getStringIndex(savedName) + 1 : 0);
+        writer->data.push_back(persistent.data);
+    }
+
+    // Used instead of the columns when only hashing:
+    thread_local std::vector<unsigned char> scratchBinary;
+    thread_local json scratchJson;
+
+    for (const std::string &componentName : persistent.saveComponents)
+    {
+        Column *column = nullptr;
+        const ComponentInfo *info = nullptr;
+        if (writer != nullptr)
+        {
+            column = writer->getOrCreateColumn(componentName);
+            info = column != nullptr ? column->info : nullptr;
+        }
+        else
+        {
+            info = findComponentInfo(componentName.c_str());
+        }
+        if (info == nullptr || !info->hasComponent(entity, registry))
+        {
+            continue;
+        }
+        hash = hashString(hash, componentName.c_str());
+
+        if (info->appendBinary)
+        {
+            std::vector<unsigned char> &payload = column != nullptr ? column->binaryPayload : scratchBinary;
+            if (column == nullptr)
+            {
+                scratchBinary.clear();
+            }
+            const size_t sizeOffset = payload.size();
+            appendValue(payload, uint32_t(0));
+            info->appendBinary(entity, registry, payload);
+
+            const size_t componentBegin = sizeOffset + sizeof(uint32_t);
+            const uint32_t componentSize = uint32_t(payload.size() - componentBegin);
+            std::memcpy(&payload[sizeOffset], &componentSize, sizeof(uint32_t));
+            hash = hashBytes(hash, payload.data() + componentBegin, componentSize);
+        }
+        else if (info->getJsonArray)
+        {
+            json &componentJson = column != nullptr ? column->cborPayload.emplace_back() : scratchJson;
+            info->getJsonArray(entity, registry, componentJson);
+            hash = hashValue(hash, uint64_t(std::hash<json>()(componentJson)));
+        }
+        if (column != nullptr)
+        {
+            column->rows.push_back(row);
+        }
+    }
+    return hash;
+}
+
+dibidab::level::EntityColumnsWriter::Column *dibidab::level::EntityColumnsWriter::getOrCreateColumn(const std::string &componentName)
+{
+    auto it = columns.find(componentName);
+    if (it != columns.end())
+    {
+        return &it->second;
+    }
+    const ComponentInfo *info = findComponentInfo(componentName.c_str());
+    if (info == nullptr)
+    {
+        warnAboutSavedComponent(componentName, "not a registered component, it is not saved");
+        return nullptr;
+    }
+    if (!info->bFunctionsRegistered)
+    {
+        warnAboutSavedComponent(
+            componentName, "registerComponentFunctions() was not called for it, it might be saved as CBOR instead of binary"
+        );
+    }
+    Column &column = columns[componentName];
+    column.info = info;
+    column.nameIndex = getStringIndex(componentName);
+    column.encoding = info->appendBinary ? entity_columns::Encoding::Binary
+        : (info->getJsonArray ? entity_columns::Encoding::Cbor : entity_columns::Encoding::Empty);
+    return &column;
+}
+
+void dibidab::level::EntityColumnsWriter::write(std::vector<unsigned char> &out) const
+{
+    appendValue(out, uint32_t(hints.size()));
+    appendValues(out, hints);
+
+    appendValue(out, uint32_t(strings.size()));
+    for (const std::string &str : strings)
+    {
+        appendValue(out, uint16_t(str.size()));
+        out.insert(out.end(), str.begin(), str.end());
+    }
+    appendValues(out, templates);
+    appendValues(out, names);
+    appendCbor(out, data);
+
+    appendValue(out, uint32_t(columns.size()));
+    for (const auto &[componentName, column] : columns)
+    {
+        appendValue(out, column.nameIndex);
+        appendValue(out, column.encoding);
+        appendValue(out, column.encoding == entity_columns::Encoding::Binary ? entity_columns::getLayoutHash(*column.info) : uint64_t(0));
+        appendValue(out, uint32_t(column.rows.size()));
+        appendValues(out, column.rows);
+
+        if (column.encoding == entity_columns::Encoding::Binary)
+        {
+            appendValue(out, uint64_t(column.binaryPayload.size()));
+            out.insert(out.end(), column.binaryPayload.begin(), column.binaryPayload.end());
+        }
+        else if (column.encoding == entity_columns::Encoding::Cbor)
+        {
+            appendCbor(out, column.cborPayload);
+        }
+        else
+        {
+            appendValue(out, uint64_t(0));
+        }
+    }
+}
+
+uint32_t dibidab::level::EntityColumnsWriter::getStringIndex(const std::string &str)
+{
+    auto it = stringIndices.find(str);
+    if (it != stringIndices.end())
+    {
+        return it->second;
+    }
+    const uint32_t index = uint32_t(strings.size());
+    strings.push_back(str);
+    stringIndices[str] = index;
+    return index;
+}
+
+dibidab::level::EntityColumnsReader::EntityColumnsReader(const unsigned char *data, size_t size)
+{
+    Cursor cursor(data, size);
+
+    const uint32_t nrOfRows = cursor.read<uint32_t>();
+    hints = cursor.readValues<entt::entity>(nrOfRows);
+
+    strings.resize(cursor.read<uint32_t>());
+    for (std::string &str : strings)
+    {
+        const uint16_t length = cursor.read<uint16_t>();
+        const unsigned char *characters = cursor.skip(length);
+        str.assign(characters, characters + length);
+    }
+    templates = cursor.readValues<uint32_t>(nrOfRows);
+    names = cursor.readValues<uint32_t>(nrOfRows);
+    this->data = cursor.readCbor();
+
+    for (uint32_t row = 0; row < nrOfRows; row++)
+    {
+        if (templates[row] >= strings.size() || names[row] > strings.size())
+        {
+            throw gu_err("Invalid string index in entity columns");
+        }
+    }
+    if (!this->data.is_array() || this->data.size() != nrOfRows)
+    {
+        throw gu_err("Entity columns do not contain data for every entity");
+    }
+
+    columns.resize(cursor.read<uint32_t>());
+    for (Column &column : columns)
+    {
+        const uint32_t nameIndex = cursor.read<uint32_t>();
+        if (nameIndex >= strings.size())
+        {
+            throw gu_err("Invalid string index in entity columns");
+        }
+        column.componentName = strings[nameIndex];
+        column.encoding = cursor.read<entity_columns::Encoding>();
+        column.layoutHash = cursor.read<uint64_t>();
+        column.rows = cursor.readValues<uint32_t>(cursor.read<uint32_t>());
+        for (uint32_t row : column.rows)
+        {
+            if (row >= nrOfRows)
+            {
+                throw gu_err("Column of " + column.componentName + " refers to a non existing entity");
+            }
+        }
+        column.payloadSize = cursor.read<uint64_t>();
+        column.payload = cursor.skip(column.payloadSize);
+    }
+}
+
+int dibidab::level::EntityColumnsReader::getNrOfEntities() const
+{
+    return int(hints.size());
+}
+
+entt::entity dibidab::level::EntityColumnsReader::getEntityHint(int row) const
+{
+    return hints.at(row);
+}
+
+const std::string &dibidab::level::EntityColumnsReader::getTemplate(int row) const
+{
+    return strings[templates.at(row)];
+}
+
+const std::string *dibidab::level::EntityColumnsReader::getName(int row) const
+{
+    const uint32_t nameIndex = names.at(row);
+    return nameIndex == 0 ? nullptr : &strings[nameIndex - 1];
+}
+
+const json &dibidab::level::EntityColumnsReader::getData(int row) const
+{
+    return data.at(row);
+}
+
+void dibidab::level::EntityColumnsReader::setComponents(std::vector<entt::entity> &rowEntities, entt::registry &registry) const
+{
+    for (const Column &column : columns)
+    {
+        const ComponentInfo *info = findComponentInfo(column.componentName.c_str());
+        if (info == nullptr)
+        {
+            std::cerr << "Encountered non existing component '" << column.componentName << "' while loading entities" << std::endl;
+            continue;
+        }
+        if (column.encoding == entity_columns::Encoding::Binary
+            && (info->setFromBinary == nullptr || entity_columns::getLayoutHash(*info) != column.layoutHash))
+        {
+            std::cerr << "Cannot load saved '" << column.componentName
+                << "' components, the component has no binary serializer anymore or its variables have changed" << std::endl;
+            continue;
+        }
+        json cborPayload;
+        if (column.encoding == entity_columns::Encoding::Cbor)
+        {
+            cborPayload = json::from_cbor(column.payload, column.payload + column.payloadSize);
+            if (!cborPayload.is_array() || cborPayload.size() != column.rows.size())
+            {
+                std::cerr << "Column of '" << column.componentName << "' does not contain every component" << std::endl;
+                continue;
+            }
+        }
+        if (info->reserve != nullptr)
+        {
+            info->reserve(registry, column.rows.size());
+        }
+        Cursor binaryCursor(column.payload, column.payloadSize);
+
+        for (size_t i = 0; i < column.rows.size(); i++)
+        {
+            entt::entity &entity = rowEntities.at(column.rows[i]);
+
+            const unsigned char *binary = nullptr;
+            uint32_t binarySize = 0;
+            if (column.encoding == entity_columns::Encoding::Binary)
+            {
+                // Always advance, also for skipped entities:
+                binarySize = binaryCursor.read<uint32_t>();
+                binary = binaryCursor.skip(binarySize);
+            }
+            if (entity == entt::null)
+            {
+                continue;
+            }
+            try
+            {
+                switch (column.encoding)
+                {
+                    case entity_columns::Encoding::Binary:
+                        info->setFromBinary(binary, binarySize, entity, registry);
+                        break;
+                    case entity_columns::Encoding::Cbor:
+                        if (info->setFromJson)
+                        {
+                            info->setFromJson(cborPayload[i], entity, registry);
+                            break;
+                        }
+                        // Component is not exposed to json anymore:
+                        [[fallthrough]];
+                    case entity_columns::Encoding::Empty:
+                        info->addComponent(entity, registry);
+                        break;
+                }
+            }
+            catch (std::exception &exc)
+            {
+                std::cerr << "Error while loading '" << column.componentName << "' of entity #" << int(entity) << ":\n"
+                    << exc.what() << std::endl;
+                registry.destroy(entity);
+                entity = entt::null;
+            }
+        }
+    }
+}
+
+void dibidab::level::EntityColumnsReader::toJson(json &entitiesOut) const
+{
+    entitiesOut = json::array();
+
+    // Binary components can only be converted to json by constructing them:
+    entt::registry scratchRegistry;
+    std::vector<entt::entity> rowEntities;
+
+    for (int row = 0; row < getNrOfEntities(); row++)
+    {
+        json &j = entitiesOut.emplace_back();
+        j["entityHint"] = getEntityHint(row);
+        j["template"] = getTemplate(row);
+        j["data"] = getData(row);
+        if (const std::string *name = getName(row))
+        {
+            j["name"] = *name;
+        }
+        j["components"] = json::object();
+        rowEntities.push_back(scratchRegistry.create());
+    }
+    setComponents(rowEntities, scratchRegistry);
+
+    for (const Column &column : columns)
+    {
+        const ComponentInfo *info = findComponentInfo(column.componentName.c_str());
+        if (info == nullptr)
+        {
+            continue;
+        }
+        for (uint32_t row : column.rows)
+        {
+            const entt::entity entity = rowEntities[row];
+            if (entity == entt::null || !info->hasComponent(entity, scratchRegistry))
+            {
+                continue;
+            }
+            json &componentJson = entitiesOut[row]["components"][column.componentName];
+            if (info->getJsonObject)
+            {
+                info->getJsonObject(entity, scratchRegistry, componentJson);
+            }
+            else
+            {
+                componentJson = json::object();
+            }
+        }
+    }
+}
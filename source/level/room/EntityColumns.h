@@ -0,0 +1,166 @@
+#pragma once
+#include <json.hpp>
+#include <entt/entity/registry.hpp>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dibidab::ecs
+{
+    struct Persistent;
+}
+
+namespace dibidab
+{
+    struct ComponentInfo;
+}
+
+namespace dibidab::level
+{
+    /**
+     * The persistent entities of a Room, stored as a contiguous column per component type, keyed by entity index.
+     * Components with a binary serializer (see `ComponentInfo::appendBinary`) are stored as raw bytes, others as CBOR.
+     * This is what Rooms are saved as, JSON (`Room::exportJsonData()`) is only used for exporting and debugging.
+     *
+     * Layout (native byte order):
+     *
+     *  uint32          number of entities (rows)
+     *  uint32[rows]    entity hints
+     *  uint32          number of strings, followed by the strings (uint16 length + characters)
+     *  uint32[rows]    template to apply, as index in the strings
+     *  uint32[rows]    name, as index in the strings + 1. 0 means the entity has no saved name
+     *  uint64          size of the CBOR array with the `Persistent::data` of every row, followed by the CBOR
+     *  uint32          number of columns
+     *  For each column:
+     *      uint32      component name, as index in the strings
+     *      uint8       encoding (see `entity_columns::Encoding`)
+     *      uint64      layout hash of the component's variables (binary encoding only)
+     *      uint32      number of rows in the column, followed by the row index (uint32) of each
+     *      uint64      size of the payload, followed by the payload:
+     *                  binary: per component its size (uint32) and its bytes, CBOR: an array with a Json array per component
+     */
+    namespace entity_columns
+    {
+        enum class Encoding : uint8_t
+        {
+            Binary = 0,
+            Cbor = 1,
+            Empty = 2   // Component is not exposed to json and has no binary serializer, only its presence is saved.
+        };
+
+        /**
+         * Hash of the names and types of the component's variables, and of the size of its binary form.
+         * Binary columns with a different hash than the current component are skipped when loading.
+         */
+        uint64_t getLayoutHash(const ComponentInfo &);
+    }
+
+    class EntityColumnsWriter
+    {
+      public:
+        /**
+         * Adds the entity as the next row, with the components listed in `Persistent::saveComponents`.
+         * Returns the same as `getEntityHash()`.
+         */
+        uint64_t addEntity(entt::entity, const ecs::Persistent &, const char *name, const entt::registry &);
+
+        /**
+         * Hash of everything that `addEntity()` would save of the entity. Used to find out which entities changed since a save.
+         */
+        static uint64_t getEntityHash(entt::entity, const ecs::Persistent &, const char *name, const entt::registry &);
+
+        void write(std::vector<unsigned char> &out) const;
+
+        bool isEmpty() const
+        { return hints.empty(); }
+
+      private:
+        struct Column;
+
+        /**
+         * Hashes the entity, and adds it to `writer` if not nullptr.
+         */
+        static uint64_t visitEntity(
+            EntityColumnsWriter *writer, entt::entity, const ecs::Persistent &, const char *name, const entt::registry &
+        );
+
+        Column *getOrCreateColumn(const std::string &componentName);
+
+        uint32_t getStringIndex(const std::string &);
+
+        struct Column
+        {
+            const ComponentInfo *info = nullptr;
+            uint32_t nameIndex = 0;
+            entity_columns::Encoding encoding = entity_columns::Encoding::Empty;
+            std::vector<uint32_t> rows;
+            std::vector<unsigned char> binaryPayload;
+            json cborPayload = json::array();
+        };
+
+        std::vector<entt::entity> hints;
+        std::vector<uint32_t> templates;
+        std::vector<uint32_t> names;
+        json data = json::array();
+
+        std::vector<std::string> strings;
+        std::map<std::string, uint32_t> stringIndices;
+
+        std::map<std::string, Column> columns;
+    };
+
+    /**
+     * Parses the entity columns written by `EntityColumnsWriter`.
+     * The payloads of the columns are not copied, so `data` should outlive the reader.
+     */
+    class EntityColumnsReader
+    {
+      public:
+        EntityColumnsReader(const unsigned char *data, size_t size);
+
+        int getNrOfEntities() const;
+
+        entt::entity getEntityHint(int row) const;
+
+        const std::string &getTemplate(int row) const;
+
+        /**
+         * Returns nullptr if the entity has no saved name.
+         */
+        const std::string *getName(int row) const;
+
+        const json &getData(int row) const;
+
+        /**
+         * Sets the components of all columns on `rowEntities[row]`, one column (component type) at a time,
+         * reserving space for the whole column first (see `ComponentInfo::reserve`). Rows with a null entity are skipped.
+         * If setting a component fails, the error is printed, the entity is destroyed, and its row entity is set to null.
+         */
+        void setComponents(std::vector<entt::entity> &rowEntities, entt::registry &) const;
+
+        /**
+         * Converts the entities to the same Json as `Room::exportJsonData()` does, for exporting and debugging.
+         */
+        void toJson(json &entitiesOut) const;
+
+      private:
+        struct Column
+        {
+            std::string componentName;
+            entity_columns::Encoding encoding = entity_columns::Encoding::Empty;
+            uint64_t layoutHash = 0;
+            std::vector<uint32_t> rows;
+            const unsigned char *payload = nullptr;
+            uint64_t payloadSize = 0;
+        };
+
+        std::vector<entt::entity> hints;
+        std::vector<std::string> strings;
+        std::vector<uint32_t> templates;
+        std::vector<uint32_t> names;
+        json data;
+        std::vector<Column> columns;
+    };
+}
@@ -1,30 +1,52 @@
 #include "Room.h"
 
+#include "EntityColumns.h"
 #include "../Level.h"
+#include "../LevelFile.h"
 
 #include "../../ecs/systems/SpawningSystem.h"
 #include "../../ecs/systems/LuaScriptsSystem.h"
 #include "../../ecs/components/Persistent.dibidab.h"
 #include "../../ecs/templates/Template.h"
 #include "../../reflection/ComponentInfo.h"
+#include "../../threading/WorkerPool.h"
+#include "../../profiling/TimingStats.h"
 
 #include <gu/profiler.h>
 
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <unordered_set>
+
+namespace
+{
+    uint64_t hashRoomData(const dibidab::level::RoomSectionData &roomData)
+    {
+        const std::string_view binary((const char *) roomData.binaryData.data(), roomData.binaryData.size());
+        return uint64_t(std::hash<json>()(roomData.jsonData)) * 31u + uint64_t(std::hash<std::string_view>()(binary));
+    }
+}
+
 void dibidab::level::Room::initialize(Level *lvl)
 {
     assert(lvl != nullptr);
 
     level = lvl;
+    timings = &profiling::getTimings("room " + (name.empty() ? std::to_string(roomI) : name));
 
     preLoadInitialize();
-    loadPersistentEntities();
-    postLoadInitialize();
+    beginLoadingPersistentEntities();
+    if (level->getEntityLoadingBudget() <= 0.0)
+    {
+        finishLoadingPersistentEntities();
+    }
 }
 
 void dibidab::level::Room::preLoadInitialize()
 {
-    addSystem(new ecs::LuaScriptsSystem("Lua Functions"), true); // execute lua functions first, in case they might spawn entities, same reason as below:
-    addSystem(new ecs::SpawningSystem("(De)spawning"), true); // SPAWN ENTITIES FIRST, so they get a chance to be updated before being rendered
+    addSystem(new ecs::SpawningSystem("(De)spawning"), ecs::UpdatePhase::PreSpawn); // SPAWN ENTITIES FIRST, so they get a chance to be updated before being rendered
+    addSystem(new ecs::LuaScriptsSystem("Lua Functions"), ecs::UpdatePhase::Scripts); // execute lua functions before the simulation, in case they might spawn entities
     Engine::initialize();
 }
 
@@ -33,31 +55,33 @@ void dibidab::level::Room::postLoadInitialize()
     afterLoad();
 }
 
-std::list<dibidab::ecs::System *> dibidab::level::Room::getSystemsToUpdate() const
+bool dibidab::level::Room::shouldUpdateSystem(const ecs::System *system) const
 {
-    std::list<ecs::System *> toUpdate = Engine::getSystemsToUpdate();
+    if (bScheduledForBackground && !system->bUpdatesInBackground)
+    {
+        return false;
+    }
     if (level != nullptr && level->isPaused())
     {
-        auto it = toUpdate.begin();
-        while (it != toUpdate.end())
-        {
-            if (systemsToUpdateDuringPause.find(*it) == systemsToUpdateDuringPause.end())
-            {
-                it = toUpdate.erase(it);
-            }
-            else
-            {
-                ++it;
-            }
-        }
+        return systemsToUpdateDuringPause.find(const_cast<ecs::System *>(system)) != systemsToUpdateDuringPause.end();
     }
-    return toUpdate;
+    return true;
 }
 
 void dibidab::level::Room::update(double deltaTime)
 {
-    gu::profiler::Zone roomZone("room " + std::to_string(getIndexInLevel()));
+    std::optional<gu::profiler::Zone> roomZone;
+    if (threading::isMainThread()) // Profiler zones are not thread-safe
+    {
+        roomZone.emplace("room " + std::to_string(getIndexInLevel()));
+    }
+    profiling::ScopedTiming timing(timings);
 
+    if (bScheduledForBackground != bUpdatingInBackground)
+    {
+        bScheduledForBackground = bUpdatingInBackground;
+        invalidateSystemSchedule();
+    }
     Engine::update(deltaTime);
 }
 
@@ -66,6 +90,20 @@ bool dibidab::level::Room::isLoadingPersistentEntities() const
     return bLoadingPersistentEntities;
 }
 
+float dibidab::level::Room::getLoadingProgress() const
+{
+    if (!bLoadingPersistentEntities || nrOfLoadingSteps == 0)
+    {
+        return bLoadingPersistentEntities ? 0.0f : 1.0f;
+    }
+    return float(nrOfLoadingStepsDone) / float(nrOfLoadingSteps);
+}
+
+bool dibidab::level::Room::isUpdatingInBackground() const
+{
+    return bUpdatingInBackground;
+}
+
 void dibidab::level::Room::setPersistent(bool bInPersistent)
 {
     bIsPersistent = bInPersistent;
@@ -76,100 +114,265 @@ bool dibidab::level::Room::isPersistent() const
     return bIsPersistent;
 }
 
-void dibidab::level::Room::loadPersistentEntities()
+std::vector<entt::entity> dibidab::level::Room::createPersistentEntities(const std::vector<entt::entity> &hints)
 {
-    bLoadingPersistentEntities = true;
+    entities.reserve(entities.size() + hints.size());
+    entities.reserve<ecs::Persistent>(entities.size<ecs::Persistent>() + hints.size());
 
-    std::map<entt::entity, entt::entity> hintToEntity;
+    // Hinted identifiers first, so that they are not taken by the entities without (available) hint:
+    std::vector<entt::entity> created(hints.size(), entt::null);
+    std::unordered_set<entt::entity> requestedHints;
+    requestedHints.reserve(hints.size());
 
-    for (const json &jsonEntity : jsonEntitiesToLoad)
+    for (size_t i = 0; i < hints.size(); i++)
     {
-        const entt::entity hint = jsonEntity.at("entityHint");
-        if (hint != entt::null)
+        const entt::entity hint = hints[i];
+        if (hint == entt::null)
         {
-            if (hintToEntity.find(hint) != hintToEntity.end())
-            {
-                std::cerr << "Desired entity identifier #" << std::to_string(int(hint)) << " was requested before" << std::endl;
-                continue;
-            }
+            continue;
+        }
+        if (!requestedHints.insert(hint).second)
+        {
+            std::cerr << "Desired entity identifier #" << std::to_string(int(hint)) << " was requested before" << std::endl;
+            continue;
+        }
+        created[i] = entities.create(hint);
+        if (created[i] != hint)
+        {
+            std::cerr << "Could not create desired entity identifier #" << std::to_string(int(hint)) << std::endl;
+        }
+    }
+    for (entt::entity &entity : created)
+    {
+        if (entity == entt::null)
+        {
+            entity = entities.create();
+        }
+    }
+    return created;
+}
 
-            const entt::entity entity = entities.create(hint);
-            hintToEntity[hint] = entity;
+void dibidab::level::Room::beginLoadingPersistentEntities()
+{
+    bLoadingPersistentEntities = true;
 
-            if (hint != entt::null && hint != entity)
-            {
-                std::cerr << "Could not create desired entity identifier #" << std::to_string(int(hint)) << std::endl;
-            }
+    if (!entityColumnsToLoad.empty() || !entityDeltasToLoad.empty())
+    {
+        try
+        {
+            loadEntityColumns();
+        }
+        catch (std::exception &exc)
+        {
+            std::cerr << "Error while loading entities of room '" << name << "':\n" << exc.what() << std::endl;
         }
+        entityColumnsToLoad.clear();
+        entityColumnsToLoad.shrink_to_fit();
+        entityDeltasToLoad.clear();
     }
 
+    std::vector<entt::entity> hints;
+    hints.reserve(jsonEntitiesToLoad.size());
     for (const json &jsonEntity : jsonEntitiesToLoad)
     {
-        const entt::entity hint = jsonEntity.at("entityHint");
-        entt::entity entity = entt::null;
+        hints.push_back(jsonEntity.at("entityHint"));
+    }
+    jsonEntitiesToFinish = createPersistentEntities(hints);
+
+    nrOfLoadingSteps = templatesToApply.size() + jsonEntitiesToFinish.size();
+    nrOfLoadingStepsDone = 0;
+}
 
-        if (hint != entt::null)
+bool dibidab::level::Room::continueLoadingPersistentEntities(std::chrono::steady_clock::time_point deadline)
+{
+    if (!bLoadingPersistentEntities)
+    {
+        return true;
+    }
+    for (bool bFirst = true; nrOfLoadingStepsDone < nrOfLoadingSteps; bFirst = false)
+    {
+        if (!bFirst && std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+        // Templates of entities loaded from columns first, then the entities loaded from Json:
+        const size_t step = nrOfLoadingStepsDone++;
+        if (step < templatesToApply.size())
         {
-            auto hintIt = hintToEntity.find(hint);
-            if (hintIt != hintToEntity.end())
+            const auto &[entity, applyTemplate] = templatesToApply[step];
+            if (!entities.valid(entity))
             {
-                entity = hintIt->second;
-                hintToEntity.erase(hintIt);
+                continue;
+            }
+            try
+            {
+                getTemplate(applyTemplate).createComponents(entity, true);
+            }
+            catch (std::exception &exc)
+            {
+                std::cerr << "Error while applying template '" << applyTemplate << "' to loaded entity:\n" << exc.what() << std::endl;
+                entities.destroy(entity);
             }
         }
-
-        if (!entities.valid(entity))
+        else
         {
-            entity = entities.create();
+            loadJsonEntity(step - templatesToApply.size());
         }
+    }
+    templatesToApply.clear();
+    templatesToApply.shrink_to_fit();
+    jsonEntitiesToFinish.clear();
+    jsonEntitiesToFinish.shrink_to_fit();
+    jsonEntitiesToLoad.clear();
+    bLoadingPersistentEntities = false;
 
-        try
-        {
-            auto &p = entities.assign<ecs::Persistent>(entity);
-            p.entityHint = hint;
-            p.data = jsonEntity.at("data");
+    postLoadInitialize();
+    return true;
+}
 
-            if (jsonEntity.contains("name"))
-            {
-                std::string eName = jsonEntity["name"];
-                setName(entity, eName.c_str());
-            }
+void dibidab::level::Room::finishLoadingPersistentEntities()
+{
+    continueLoadingPersistentEntities(std::chrono::steady_clock::time_point::max());
+}
+
+void dibidab::level::Room::loadJsonEntity(size_t i)
+{
+    const json &jsonEntity = jsonEntitiesToLoad[i];
+    const entt::entity entity = jsonEntitiesToFinish[i];
+    if (!entities.valid(entity))
+    {
+        return;
+    }
+    try
+    {
+        auto &p = entities.assign<ecs::Persistent>(entity);
+        // The hint might not have been available, and journals identify entities by their hint:
+        p.entityHint = entity;
+        p.data = jsonEntity.at("data");
 
-            for (auto &[componentName, componentJson] : jsonEntity.at("components").items())
+        if (jsonEntity.contains("name"))
+        {
+            std::string eName = jsonEntity["name"];
+            setName(entity, eName.c_str());
+        }
+
+        for (auto &[componentName, componentJson] : jsonEntity.at("components").items())
+        {
+            if (const ComponentInfo *info = findComponentInfo(componentName.c_str()))
             {
-                if (const ComponentInfo *info = findComponentInfo(componentName.c_str()))
+                if (info->setFromJson)
                 {
-                    if (info->setFromJson)
-                    {
-                        info->setFromJson(componentJson, entity, entities);
-                    }
-                    else
-                    {
-                        info->addComponent(entity, entities);
-                    }
+                    info->setFromJson(componentJson, entity, entities);
                 }
                 else
                 {
-                    std::cerr << "Encountered non existing component '" << componentName << "' while loading entity:\n"
-                        << jsonEntity.dump() << std::endl;
+                    info->addComponent(entity, entities);
                 }
             }
+            else
+            {
+                std::cerr << "Encountered non existing component '" << componentName << "' while loading entity:\n"
+                    << jsonEntity.dump() << std::endl;
+            }
+        }
 
-            const std::string applyTemplate = jsonEntity.at("template");
-            if (!applyTemplate.empty())
+        const std::string applyTemplate = jsonEntity.at("template");
+        if (!applyTemplate.empty())
+        {
+            getTemplate(applyTemplate).createComponents(entity, true);
+        }
+    }
+    catch (std::exception &exc)
+    {
+        std::cerr << "Error while loading entity from JSON: \n" << exc.what() << std::endl;
+        std::cerr << "entity json: " << jsonEntity.dump() << std::endl;
+        entities.destroy(entity);
+    }
+}
+
+void dibidab::level::Room::loadEntityColumns()
+{
+    // The saved entities, followed by the deltas from the journal:
+    std::vector<EntityColumnsReader> layers;
+    std::vector<const std::vector<entt::entity> *> layerDestroyedEntities;
+    if (!entityColumnsToLoad.empty())
+    {
+        layers.emplace_back(entityColumnsToLoad.data(), entityColumnsToLoad.size());
+        layerDestroyedEntities.push_back(nullptr);
+    }
+    for (const EntityDelta &delta : entityDeltasToLoad)
+    {
+        layers.emplace_back(delta.entityColumns.data(), delta.entityColumns.size());
+        layerDestroyedEntities.push_back(&delta.destroyedEntities);
+    }
+
+    // Going from the newest to the oldest layer, skip entities that were replaced or destroyed by a newer layer:
+    std::vector<std::vector<entt::entity>> layerEntities(layers.size());
+    std::vector<std::pair<int, int>> rowsToLoad;
+    std::unordered_set<entt::entity> replacedHints;
+
+    for (int layerI = int(layers.size()) - 1; layerI >= 0; layerI--)
+    {
+        const EntityColumnsReader &layer = layers[layerI];
+        layerEntities[layerI].resize(layer.getNrOfEntities(), entt::null);
+
+        for (int row = layer.getNrOfEntities() - 1; row >= 0; row--)
+        {
+            const entt::entity hint = layer.getEntityHint(row);
+            if (hint == entt::null || replacedHints.find(hint) == replacedHints.end())
             {
-                getTemplate(applyTemplate).createComponents(entity, true);
+                rowsToLoad.emplace_back(layerI, row);
             }
         }
-        catch (std::exception &exc)
+        for (int row = 0; row < layer.getNrOfEntities(); row++)
+        {
+            replacedHints.insert(layer.getEntityHint(row));
+        }
+        if (const std::vector<entt::entity> *destroyed = layerDestroyedEntities[layerI])
         {
-            std::cerr << "Error while loading entity from JSON: \n" << exc.what() << std::endl;
-            std::cerr << "entity json: " << jsonEntity.dump() << std::endl;
-            entities.destroy(entity);
+            replacedHints.insert(destroyed->begin(), destroyed->end());
+        }
+    }
+    std::reverse(rowsToLoad.begin(), rowsToLoad.end());
+
+    std::vector<entt::entity> hints;
+    hints.reserve(rowsToLoad.size());
+    for (const auto &[layerI, row] : rowsToLoad)
+    {
+        hints.push_back(layers[layerI].getEntityHint(row));
+    }
+    const std::vector<entt::entity> created = createPersistentEntities(hints);
+
+    for (size_t i = 0; i < rowsToLoad.size(); i++)
+    {
+        const auto &[layerI, row] = rowsToLoad[i];
+        const entt::entity entity = layerEntities[layerI][row] = created[i];
+
+        auto &p = entities.assign<ecs::Persistent>(entity);
+        // The hint might not have been available, and journals identify entities by their hint:
+        p.entityHint = entity;
+        p.data = layers[layerI].getData(row);
+
+        if (const std::string *eName = layers[layerI].getName(row))
+        {
+            setName(entity, eName->c_str());
+        }
+    }
+    for (size_t layerI = 0; layerI < layers.size(); layerI++)
+    {
+        layers[layerI].setComponents(layerEntities[layerI], entities);
+    }
+
+    // Templates can be slow (Lua), so these are applied by `continueLoadingPersistentEntities()`:
+    for (const auto &[layerI, row] : rowsToLoad)
+    {
+        const entt::entity entity = layerEntities[layerI][row];
+        const std::string &applyTemplate = layers[layerI].getTemplate(row);
+        if (entity != entt::null && !applyTemplate.empty())
+        {
+            templatesToApply.emplace_back(entity, applyTemplate);
         }
     }
-    jsonEntitiesToLoad.clear();
-    bLoadingPersistentEntities = false;
 }
 
 void dibidab::level::Room::persistentEntityToJson(entt::entity e, const ecs::Persistent &persistent, json &j) const
@@ -205,11 +408,19 @@ void dibidab::level::Room::persistentEntityToJson(entt::entity e, const ecs::Per
 
 void dibidab::level::Room::exportJsonData(json &j)
 {
+    if (bLoadingPersistentEntities)
+    {
+        finishLoadingPersistentEntities();
+    }
     events.emit(0, "BeforeSave");
     j = json {
         {"name", name},
-        {"entities", json::array()},
     };
+    if (bExportingEntityColumns)
+    {
+        return;
+    }
+    j["entities"] = json::array();
     entities.view<const ecs::Persistent>().each([&](auto e, const ecs::Persistent &persistent)
     {
         j["entities"].push_back(json::object());
@@ -220,5 +431,98 @@ void dibidab::level::Room::exportJsonData(json &j)
 void dibidab::level::Room::loadJsonData(const json &j)
 {
     name = j.at("name");
-    jsonEntitiesToLoad = j.at("entities");
+    // Saved Levels store the entities as columns instead:
+    jsonEntitiesToLoad = j.value("entities", json::array());
+}
+
+void dibidab::level::Room::exportJsonDataWithoutEntities(json &j)
+{
+    bExportingEntityColumns = true;
+    try
+    {
+        exportJsonData(j);
+    }
+    catch (...)
+    {
+        bExportingEntityColumns = false;
+        throw;
+    }
+    bExportingEntityColumns = false;
+}
+
+dibidab::level::RoomSectionData dibidab::level::Room::exportForSave()
+{
+    if (bLoadingPersistentEntities)
+    {
+        finishLoadingPersistentEntities();
+    }
+    RoomSectionData roomData;
+    roomData.name = name;
+    exportJsonDataWithoutEntities(roomData.jsonData);
+
+    savedEntityHashes.clear();
+    EntityColumnsWriter columns;
+    entities.view<ecs::Persistent>().each([&](auto e, ecs::Persistent &persistent)
+    {
+        // Entities are identified by their hint in journals, so it should be the entity itself:
+        persistent.entityHint = e;
+        savedEntityHashes[e] = columns.addEntity(e, persistent, getName(e), entities);
+    });
+    columns.write(roomData.entityColumns);
+
+    exportBinaryData(roomData.binaryData);
+
+    savedRoomDataHash = hashRoomData(roomData);
+    bSavedHashesKnown = true;
+    return roomData;
+}
+
+bool dibidab::level::Room::exportJournalDelta(RoomSectionData &deltaOut, std::vector<entt::entity> &destroyedOut, bool &bChangedOut)
+{
+    if (!bSavedHashesKnown)
+    {
+        return false;
+    }
+    if (bLoadingPersistentEntities)
+    {
+        finishLoadingPersistentEntities();
+    }
+    deltaOut.name = name;
+    exportJsonDataWithoutEntities(deltaOut.jsonData);
+
+    std::unordered_map<entt::entity, uint64_t> entityHashes;
+    entityHashes.reserve(savedEntityHashes.size());
+
+    EntityColumnsWriter changedEntities;
+    entities.view<ecs::Persistent>().each([&](auto e, ecs::Persistent &persistent)
+    {
+        persistent.entityHint = e;
+        const char *eName = getName(e);
+        const uint64_t hash = EntityColumnsWriter::getEntityHash(e, persistent, eName, entities);
+        auto savedIt = savedEntityHashes.find(e);
+        if (savedIt == savedEntityHashes.end() || savedIt->second != hash)
+        {
+            changedEntities.addEntity(e, persistent, eName, entities);
+        }
+        entityHashes[e] = hash;
+    });
+    for (const auto &[e, hash] : savedEntityHashes)
+    {
+        // Destroyed, or no longer persistent:
+        if (entityHashes.find(e) == entityHashes.end())
+        {
+            destroyedOut.push_back(e);
+        }
+    }
+    std::sort(destroyedOut.begin(), destroyedOut.end());
+    changedEntities.write(deltaOut.entityColumns);
+
+    exportBinaryData(deltaOut.binaryData);
+
+    const uint64_t roomDataHash = hashRoomData(deltaOut);
+    bChangedOut = !changedEntities.isEmpty() || !destroyedOut.empty() || roomDataHash != savedRoomDataHash;
+
+    savedEntityHashes = std::move(entityHashes);
+    savedRoomDataHash = roomDataHash;
+    return true;
 }
@@ -1,20 +1,38 @@
 #pragma once
 #include "../../ecs/Engine.h"
+#include "../LevelFile.h"
 
 #include <utils/delegate.h>
 #include <json.hpp>
 
+#include <chrono>
 #include <set>
+#include <unordered_map>
 
 namespace dibidab::ecs
 {
     struct Persistent;
 }
 
+namespace dibidab::profiling
+{
+    class RollingTimings;
+}
+
 namespace dibidab::level
 {
     class Level;
 
+    /**
+     * How a Room is simulated by its Level.
+     */
+    enum class RoomSimulation
+    {
+        Full,       // Updated every Level update.
+        Background, // Updated at a reduced rate, with larger delta times. See `Level::backgroundUpdatesPerSecond`.
+        Frozen      // Not updated at all.
+    };
+
     /**
      * A room is part of a level.
      */
@@ -30,12 +48,31 @@ namespace dibidab::level
 
         void update(double deltaTime) override;
 
+        /**
+         * True until all persistent entities are loaded and `afterLoad` is called.
+         * If the Level has an entity loading budget (see `Level::setEntityLoadingBudget()`), loading can take multiple frames,
+         * during which the Room is not updated.
+         */
         bool isLoadingPersistentEntities() const;
 
+        /**
+         * From 0 to 1, for showing a loading animation. 1 if the Room is not loading.
+         */
+        float getLoadingProgress() const;
+
+        /**
+         * Returns true if the current/last update was a reduced rate background update.
+         */
+        bool isUpdatingInBackground() const;
+
         void setPersistent(bool bPersistent);
 
         bool isPersistent() const;
 
+        /**
+         * Exports the Room, including all persistent entities, as Json. Used for exporting and debugging,
+         * saving the Level stores the persistent entities as binary columns instead, see `EntityColumns.h`.
+         */
         virtual void exportJsonData(json &);
 
         virtual void loadJsonData(const json &);
@@ -46,6 +83,13 @@ namespace dibidab::level
         virtual void loadBinaryData(const unsigned char *data, uint64 dataLength)
         {};
 
+        /**
+         * Called instead of `loadBinaryData()` if the binary data is a view into a mapped level file (see `LevelFileReader::readRoom()`).
+         * The Room can keep the view to use large data (like tile maps) without copying it.
+         */
+        virtual void loadMappedBinaryData(const MappedBytes &data)
+        { loadBinaryData(data.data, data.size); };
+
         std::string name;
 
         delegate<void()> afterLoad;
@@ -56,15 +100,62 @@ namespace dibidab::level
 
         virtual void postLoadInitialize();
 
-        std::list<ecs::System *> getSystemsToUpdate() const override;
+        bool shouldUpdateSystem(const ecs::System *) const override;
 
+        /**
+         * Systems that keep updating while the Level is paused.
+         * Call `invalidateSystemSchedule()` after changing this set while the room is already running.
+         */
         std::set<ecs::System *> systemsToUpdateDuringPause;
 
       private:
 
         void initialize(Level *lvl);
 
-        void loadPersistentEntities();
+        /**
+         * Creates the persistent entities and sets their saved components.
+         * Applying templates and loading entities saved as Json is done by `continueLoadingPersistentEntities()`.
+         */
+        void beginLoadingPersistentEntities();
+
+        /**
+         * Loads entities until all are loaded, or until `deadline` has passed. At least one entity is loaded per call.
+         * Returns true (after calling `postLoadInitialize()`) when all are loaded.
+         */
+        bool continueLoadingPersistentEntities(std::chrono::steady_clock::time_point deadline);
+
+        void finishLoadingPersistentEntities();
+
+        void loadJsonEntity(size_t i);
+
+        /**
+         * Creates an entity for each hint, using the hinted identifier if it is still available.
+         */
+        std::vector<entt::entity> createPersistentEntities(const std::vector<entt::entity> &hints);
+
+        /**
+         * Loads `entityColumnsToLoad` and `entityDeltasToLoad`. Entities in later deltas replace those with the same hint.
+         */
+        void loadEntityColumns();
+
+        void exportJsonDataWithoutEntities(json &);
+
+        /**
+         * Exports the Json data without entities, the persistent entities as columns, and the binary data.
+         * Remembers what was exported, see `exportJournalDelta()`.
+         */
+        RoomSectionData exportForSave();
+
+        /**
+         * Exports the Json and binary data, and only the persistent entities that changed since the previous save.
+         * Changes are found by comparing the hash of every persistent entity with its hash at the previous save,
+         * because components can be changed in place without EnTT knowing (by Lua, or by Systems).
+         * Hashing is much cheaper than encoding and compressing all entities.
+         *
+         * Returns false if the Room does not know what was saved before (it was not saved since it was loaded),
+         * then `exportForSave()` should be used instead. `bChangedOut` is set to false if nothing changed at all.
+         */
+        bool exportJournalDelta(RoomSectionData &deltaOut, std::vector<entt::entity> &destroyedOut, bool &bChangedOut);
 
         void persistentEntityToJson(entt::entity, const ecs::Persistent &, json &j) const;
 
@@ -73,7 +164,32 @@ namespace dibidab::level
 
         bool bIsPersistent = true;
 
+        profiling::RollingTimings *timings = nullptr;
+
+        bool bUpdatingInBackground = false;
+        bool bScheduledForBackground = false;
+        double backgroundUpdateAccumulator = -1.0;
+        // Random start of the accumulator, which is not time that has passed:
+        double backgroundUpdateOffset = 0.0;
+
+        // Level time at which this Room was last needed, used for deactivating Rooms:
+        double lastNeededTime = 0.0;
+
         json jsonEntitiesToLoad;
+        // Entities created for `jsonEntitiesToLoad`, and templates to apply to entities loaded from columns:
+        std::vector<entt::entity> jsonEntitiesToFinish;
+        std::vector<std::pair<entt::entity, std::string>> templatesToApply;
+        size_t nrOfLoadingSteps = 0, nrOfLoadingStepsDone = 0;
+        std::vector<unsigned char> entityColumnsToLoad;
+        // Changes made after `entityColumnsToLoad` was saved, from the journal of the level file:
+        std::vector<EntityDelta> entityDeltasToLoad;
+        bool bExportingEntityColumns = false;
+
+        // Hash of every persistent entity and of the Room's own data at the previous save.
+        // Persistent entities are identified by their entity, which is also stored as their hint:
+        std::unordered_map<entt::entity, uint64_t> savedEntityHashes;
+        uint64_t savedRoomDataHash = 0;
+        bool bSavedHashesKnown = false;
         bool bLoadingPersistentEntities = false;
 
         friend void from_json(const json &j, Level &lvl);
@@ -4,22 +4,30 @@
 #include "../reflection/EnumInfo.h"
 #include "../behavior/Tree.h"
 #include "../level/Level.h"
-#include "../dibidab/dibidab.h"
+#include "../dibidab/dibidab_core.h"
+#include "../profiling/TimingStats.h"
 
 #include <input/gamepad_input.h>
-#include <gu/game_utils.h>
+
+#include <mutex>
 
 luau::Script::Script(const std::string &path) : path(path)
 {}
 
 const sol::bytecode &luau::Script::getByteCode()
 {
+    // Scripts can be included by Engines with their own Lua state, on different threads:
+    static std::mutex compileMutex;
+    std::lock_guard<std::mutex> lock(compileMutex);
+
     if (!bytecode.empty())
     {
         return bytecode;
     }
 
-    sol::load_result lr = luau::getLuaState().load_file(path);
+    // Bytecode does not depend on the state it is compiled in, so use a fresh one instead of a shared one:
+    sol::state compileState;
+    sol::load_result lr = compileState.load_file(path);
     if (!lr.valid())
     {
         throw gu_err("Lua code invalid!:\n" + std::string(lr.get<sol::error>().what()));
@@ -124,117 +132,152 @@ sol::state &luau::getLuaState()
     if (lua == nullptr)
     {
         lua = new sol::state;
-        lua->open_libraries(sol::lib::base, sol::lib::string, sol::lib::math, sol::lib::table);
+        initializeLuaState(*lua);
+    }
+    return *lua;
+}
 
-        auto &env = lua->globals();
+void luau::initializeLuaState(sol::state &lua)
+{
+    lua.open_libraries(sol::lib::base, sol::lib::string, sol::lib::math, sol::lib::table);
 
-        env["getGameStartupArgs"] = []
-        {
-            return &dibidab::startupArgs;
-        };
-        env["tryCloseGame"] = []
-        {
-            gu::setShouldClose(true);
-        };
+    auto &env = lua.globals();
 
-        env["loadOrCreateLevel"] = [] (const sol::optional<std::string> &path)
-        {
-            dibidab::setLevel(path.has_value() ? new dibidab::level::Level(path.value().c_str()) : nullptr);
-        };
+    env["getGameStartupArgs"] = []
+    {
+        return &dibidab::startupArgs;
+    };
+    env["tryCloseGame"] = []
+    {
+        dibidab::requestClose();
+    };
 
-        env["include"] = [&] (const char *scriptPath, const sol::this_environment &currentEnv) -> sol::environment
-        {
-            auto newEnv = sol::environment(getLuaState(), sol::create, currentEnv.env.value_or(env));
+    env["loadOrCreateLevel"] = [] (const sol::optional<std::string> &path)
+    {
+        dibidab::setLevel(path.has_value() ? new dibidab::level::Level(path.value().c_str()) : nullptr);
+    };
 
-            asset<Script> toBeIncluded(scriptPath);
-            getLuaState().unsafe_script(toBeIncluded->getByteCode().as_string_view(), newEnv);
-            return newEnv;
-        };
+    env["include"] = [] (const char *scriptPath, const sol::this_environment &currentEnv, sol::this_state currentState) -> sol::environment
+    {
+        sol::state_view lua(currentState);
+        auto newEnv = sol::environment(lua, sol::create, currentEnv.env.value_or(lua.globals()));
 
-        // register dibidab headers:
-        for (const auto &[name, structInfo] : dibidab::getAllStructInfos())
+        asset<Script> toBeIncluded(scriptPath);
+        lua.unsafe_script(toBeIncluded->getByteCode().as_string_view(), newEnv);
+        return newEnv;
+    };
+
+    env["getTimingStats"] = [] (const std::string &name, sol::this_state currentState) -> sol::optional<sol::table>
+    {
+        const dibidab::profiling::RollingTimings *timings = dibidab::profiling::findTimings(name);
+        if (timings == nullptr)
         {
-            if (structInfo.registerLuaUserType)
-            {
-                structInfo.registerLuaUserType(*lua);
-            }
+            return sol::nullopt;
         }
-        for (const auto &[name, enumInfo] : dibidab::getAllEnumInfos())
+        const dibidab::profiling::RollingTimings::Summary summary = timings->getSummary();
+        return sol::state_view(currentState).create_table_with(
+            "min", summary.min,
+            "mean", summary.mean,
+            "p95", summary.p95,
+            "p99", summary.p99,
+            "max", summary.max,
+            "samples", summary.nrOfSamples,
+            "count", summary.count
+        );
+    };
+    env["getTimingStatNames"] = [] ()
+    {
+        // As table, so that `ipairs()` and `#` work in Lua:
+        return sol::as_table(dibidab::profiling::getTimingNames());
+    };
+    env["dumpTimingStats"] = [] (const char *path)
+    {
+        dibidab::profiling::dumpTimings(path);
+    };
+
+    // register dibidab headers:
+    for (const auto &[name, structInfo] : dibidab::getAllStructInfos())
+    {
+        if (structInfo.registerLuaUserType)
         {
-            enumInfo.registerLuaEnum(*lua);
+            structInfo.registerLuaUserType(lua);
         }
+    }
+    for (const auto &[name, enumInfo] : dibidab::getAllEnumInfos())
+    {
+        enumInfo.registerLuaEnum(lua);
+    }
 
-        // register glm vectors:
-        registerVecUserType<int>("ivec", *lua);
-        registerVecUserType<int8>("i8vec", *lua);
-        registerVecUserType<int16>("i16vec", *lua);
-        registerVecUserType<uint>("uvec", *lua);
-        registerVecUserType<uint8>("u8vec", *lua);
-        registerVecUserType<uint16>("u16vec", *lua);
-        registerVecUserType<float>("vec", *lua);
+    // register glm vectors:
+    registerVecUserType<int>("ivec", lua);
+    registerVecUserType<int8>("i8vec", lua);
+    registerVecUserType<int16>("i16vec", lua);
+    registerVecUserType<uint>("uvec", lua);
+    registerVecUserType<uint8>("u8vec", lua);
+    registerVecUserType<uint16>("u16vec", lua);
+    registerVecUserType<float>("vec", lua);
 
-        // register glm quat:
-        sol::usertype<quat> qut = lua->new_usertype<quat>("quat");
+    // register glm quat:
+    sol::usertype<quat> qut = lua.new_usertype<quat>("quat");
 
-        for (int axis = 0; axis < 3; axis++)
-        {
-            qut[axis == 0 ? "x" : (axis == 1 ? "y" : "z")] = sol::property(
-                [axis] (quat &q)
-                {
-                    return glm::eulerAngles(q)[axis] * mu::RAD_TO_DEGREES;
-                },
-                [axis] (quat &q, float x)
-                {
-                    vec3 euler = glm::eulerAngles(q);
-                    euler[axis] = x * mu::DEGREES_TO_RAD;
-                    q = quat(euler);
-                }
-            );
-        }
-        qut["setIdentity"] = [] (quat &q) -> quat &
-        {
-            q = quat(1, 0, 0, 0);
-            return q;
-        };
-        qut["getAngle"] = [] (quat &q) -> float { return angle(q) * mu::RAD_TO_DEGREES; };
-        qut["getAxis"] = [] (quat &q) -> vec3 { return axis(q); };
-        qut["setFromAngleAndAxis"] = [] (quat &q, float angle, vec3 axis)
-        {
-            q = angleAxis(angle * mu::DEGREES_TO_RAD, axis);
-        };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        qut[axis == 0 ? "x" : (axis == 1 ? "y" : "z")] = sol::property(
+            [axis] (quat &q)
+            {
+                return glm::eulerAngles(q)[axis] * mu::RAD_TO_DEGREES;
+            },
+            [axis] (quat &q, float x)
+            {
+                vec3 euler = glm::eulerAngles(q);
+                euler[axis] = x * mu::DEGREES_TO_RAD;
+                q = quat(euler);
+            }
+        );
+    }
+    qut["setIdentity"] = [] (quat &q) -> quat &
+    {
+        q = quat(1, 0, 0, 0);
+        return q;
+    };
+    qut["getAngle"] = [] (quat &q) -> float { return angle(q) * mu::RAD_TO_DEGREES; };
+    qut["getAxis"] = [] (quat &q) -> vec3 { return axis(q); };
+    qut["setFromAngleAndAxis"] = [] (quat &q, float angle, vec3 axis)
+    {
+        q = angleAxis(angle * mu::DEGREES_TO_RAD, axis);
+    };
 
-        // register KeyInput::Key
-        sol::usertype<KeyInput::Key> key = lua->new_usertype<KeyInput::Key>("Key");
-        key["getName"] = [] (KeyInput::Key &key)
-        {
-            return KeyInput::getKeyName(key);
-        };
+    // register KeyInput::Key
+    sol::usertype<KeyInput::Key> key = lua.new_usertype<KeyInput::Key>("Key");
+    key["getName"] = [] (KeyInput::Key &key)
+    {
+        return KeyInput::getKeyName(key);
+    };
 
-        // register GamepadInput::Button
-        sol::usertype<GamepadInput::Button> gpb = lua->new_usertype<GamepadInput::Button>("GamepadButton");
-        gpb["getName"] = [] (GamepadInput::Button &key)
-        {
-            return GamepadInput::getButtonName(key);
-        };
+    // register GamepadInput::Button
+    sol::usertype<GamepadInput::Button> gpb = lua.new_usertype<GamepadInput::Button>("GamepadButton");
+    gpb["getName"] = [] (GamepadInput::Button &key)
+    {
+        return GamepadInput::getButtonName(key);
+    };
 
-        // register GamepadInput::Axis
-        sol::usertype<GamepadInput::Axis> gpa = lua->new_usertype<GamepadInput::Axis>("GamepadAxis");
-        gpa["getName"] = [] (GamepadInput::Axis &key)
-        {
-            return GamepadInput::getAxisName(key);
-        };
+    // register GamepadInput::Axis
+    sol::usertype<GamepadInput::Axis> gpa = lua.new_usertype<GamepadInput::Axis>("GamepadAxis");
+    gpa["getName"] = [] (GamepadInput::Axis &key)
+    {
+        return GamepadInput::getAxisName(key);
+    };
 
-        dibidab::behavior::Tree::addToLuaEnvironment(lua);
-    }
-    return *lua;
+    dibidab::behavior::Tree::addToLuaEnvironment(&lua);
 }
 
 sol::environment luau::environmentFromScript(luau::Script &script, sol::environment *parent)
 {
-    sol::environment env = parent ? sol::environment(getLuaState(), sol::create, *parent)
-        : sol::environment(getLuaState(), sol::create, getLuaState().globals());
+    sol::state_view lua(parent ? parent->lua_state() : getLuaState().lua_state());
+    sol::environment env = parent ? sol::environment(lua, sol::create, *parent)
+        : sol::environment(lua, sol::create, lua.globals());
 
-    sol::protected_function_result result = luau::getLuaState().safe_script(script.getByteCode().as_string_view(), env);
+    sol::protected_function_result result = lua.safe_script(script.getByteCode().as_string_view(), env);
     if (!result.valid())
     {
         throw gu_err(result.get<sol::error>().what());
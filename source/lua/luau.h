@@ -22,8 +22,16 @@ namespace luau
         sol::bytecode bytecode;
     };
 
+    /**
+     * Returns the process-wide Lua state, which is used by all Engines that do not have their own Lua state.
+     */
     sol::state &getLuaState();
 
+    /**
+     * Opens the standard libraries and registers all struct/enum usertypes, vector types and behavior tree types.
+     */
+    void initializeLuaState(sol::state &);
+
     template <typename ...Args>
     void callFunction(sol::function func, Args&&... args)
     {
@@ -0,0 +1,214 @@
+#include "TimingStats.h"
+
+#include <files/file_utils.h>
+#include <utils/string_utils.h>
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace
+{
+    std::mutex allTimingsMutex;
+
+    std::map<std::string, std::unique_ptr<dibidab::profiling::RollingTimings>> &getAllTimings()
+    {
+        static std::map<std::string, std::unique_ptr<dibidab::profiling::RollingTimings>> timings;
+        return timings;
+    }
+
+    std::atomic<bool> bTimingsEnabled { true };
+
+    double percentile(std::vector<float> &sorted, double fraction)
+    {
+        const size_t i = std::min(sorted.size() - 1, size_t(fraction * double(sorted.size())));
+        return sorted[i];
+    }
+}
+
+dibidab::profiling::RollingTimings::RollingTimings(int windowSize)
+{
+    samples.reserve(windowSize);
+}
+
+void dibidab::profiling::RollingTimings::add(double milliseconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (samples.size() < samples.capacity())
+    {
+        samples.push_back(float(milliseconds));
+    }
+    else
+    {
+        samples[nextSample] = float(milliseconds);
+        nextSample = (nextSample + 1) % int(samples.size());
+    }
+    count++;
+}
+
+dibidab::profiling::RollingTimings::Summary dibidab::profiling::RollingTimings::getSummary() const
+{
+    std::vector<float> sorted;
+    Summary summary;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = samples;
+        summary.count = count;
+    }
+    summary.nrOfSamples = int(sorted.size());
+    if (sorted.empty())
+    {
+        return summary;
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    double total = 0.0;
+    for (float sample : sorted)
+    {
+        total += sample;
+    }
+    summary.min = sorted.front();
+    summary.max = sorted.back();
+    summary.mean = total / double(sorted.size());
+    summary.p95 = percentile(sorted, 0.95);
+    summary.p99 = percentile(sorted, 0.99);
+    return summary;
+}
+
+void dibidab::profiling::RollingTimings::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    samples.clear();
+    nextSample = 0;
+    count = 0;
+}
+
+dibidab::profiling::RollingTimings &dibidab::profiling::getTimings(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(allTimingsMutex);
+    std::unique_ptr<RollingTimings> &timings = getAllTimings()[name];
+    if (timings == nullptr)
+    {
+        timings = std::make_unique<RollingTimings>();
+    }
+    return *timings;
+}
+
+const dibidab::profiling::RollingTimings *dibidab::profiling::findTimings(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(allTimingsMutex);
+    const auto &allTimings = getAllTimings();
+    auto it = allTimings.find(name);
+    return it == allTimings.end() ? nullptr : it->second.get();
+}
+
+std::vector<std::string> dibidab::profiling::getTimingNames()
+{
+    std::vector<std::string> names;
+    std::lock_guard<std::mutex> lock(allTimingsMutex);
+    for (const auto &[name, timings] : getAllTimings())
+    {
+        names.push_back(name);
+    }
+    return names;
+}
+
+std::map<std::string, dibidab::profiling::RollingTimings::Summary> dibidab::profiling::getAllTimingSummaries()
+{
+    std::map<std::string, RollingTimings::Summary> summaries;
+    std::lock_guard<std::mutex> lock(allTimingsMutex);
+    for (const auto &[name, timings] : getAllTimings())
+    {
+        summaries[name] = timings->getSummary();
+    }
+    return summaries;
+}
+
+void dibidab::profiling::clearAllTimings()
+{
+    std::lock_guard<std::mutex> lock(allTimingsMutex);
+    for (auto &[name, timings] : getAllTimings())
+    {
+        timings->clear();
+    }
+}
+
+void dibidab::profiling::timingsToJson(json &j)
+{
+    j = json::object();
+    for (const auto &[name, summary] : getAllTimingSummaries())
+    {
+        j[name] = {
+            { "min", summary.min },
+            { "mean", summary.mean },
+            { "p95", summary.p95 },
+            { "p99", summary.p99 },
+            { "max", summary.max },
+            { "samples", summary.nrOfSamples },
+            { "count", summary.count }
+        };
+    }
+}
+
+std::string dibidab::profiling::timingsToCsv()
+{
+    std::string csv = "name,min,mean,p95,p99,max,samples,count\n";
+    for (const auto &[name, summary] : getAllTimingSummaries())
+    {
+        csv += "\"" + name + "\","
+            + std::to_string(summary.min) + ","
+            + std::to_string(summary.mean) + ","
+            + std::to_string(summary.p95) + ","
+            + std::to_string(summary.p99) + ","
+            + std::to_string(summary.max) + ","
+            + std::to_string(summary.nrOfSamples) + ","
+            + std::to_string(summary.count) + "\n";
+    }
+    return csv;
+}
+
+void dibidab::profiling::dumpTimings(const char *path)
+{
+    std::string output;
+    if (su::endsWith(path, ".csv"))
+    {
+        output = timingsToCsv();
+    }
+    else
+    {
+        json j;
+        timingsToJson(j);
+        output = j.dump(2);
+    }
+    fu::writeBinary(path, output.data(), output.size());
+}
+
+void dibidab::profiling::setTimingsEnabled(bool bEnabled)
+{
+    bTimingsEnabled = bEnabled;
+}
+
+bool dibidab::profiling::areTimingsEnabled()
+{
+    return bTimingsEnabled;
+}
+
+dibidab::profiling::ScopedTiming::ScopedTiming(RollingTimings *timings) :
+    timings(bTimingsEnabled ? timings : nullptr)
+{
+    if (this->timings != nullptr)
+    {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+dibidab::profiling::ScopedTiming::~ScopedTiming()
+{
+    if (timings != nullptr)
+    {
+        const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        timings->add(duration.count());
+    }
+}
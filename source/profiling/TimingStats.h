@@ -0,0 +1,101 @@
+#pragma once
+
+#include <json_fwd.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dibidab::profiling
+{
+    /**
+     * Keeps the most recent timings of something that happens repeatedly (like updating a System),
+     * so that statistics can be queried at any time. Thread-safe.
+     */
+    class RollingTimings
+    {
+      public:
+        struct Summary
+        {
+            // In milliseconds, over the samples currently in the window:
+            double min = 0.0;
+            double mean = 0.0;
+            double p95 = 0.0;
+            double p99 = 0.0;
+            double max = 0.0;
+            int nrOfSamples = 0;
+            // Total number of recorded timings, including the ones that fell out of the window:
+            uint64_t count = 0;
+        };
+
+        explicit RollingTimings(int windowSize = 512);
+
+        void add(double milliseconds);
+
+        Summary getSummary() const;
+
+        void clear();
+
+      private:
+        mutable std::mutex mutex;
+        std::vector<float> samples;
+        int nextSample = 0;
+        uint64_t count = 0;
+    };
+
+    /**
+     * Returns the timings with the given name, creating them if they do not exist yet.
+     * The returned reference stays valid for the rest of the program, so it can be cached.
+     *
+     * Names used by the engine:
+     *  - "level update"
+     *  - "room <index or name>"
+     *  - "system <System::name>" (combined for all Rooms)
+     */
+    RollingTimings &getTimings(const std::string &name);
+
+    /**
+     * Returns nullptr if there are no timings with the given name, instead of creating them.
+     */
+    const RollingTimings *findTimings(const std::string &name);
+
+    std::vector<std::string> getTimingNames();
+
+    std::map<std::string, RollingTimings::Summary> getAllTimingSummaries();
+
+    void clearAllTimings();
+
+    void timingsToJson(json &);
+
+    std::string timingsToCsv();
+
+    /**
+     * Writes all timing summaries to a file, as CSV if the path ends with ".csv", else as JSON.
+     */
+    void dumpTimings(const char *path);
+
+    /**
+     * Timings are recorded by default. Disabling this removes the (small) cost of measuring.
+     */
+    void setTimingsEnabled(bool bEnabled);
+
+    bool areTimingsEnabled();
+
+    /**
+     * Adds the time between its construction and destruction to `timings`. Does nothing if `timings` is nullptr,
+     * or if timings are disabled.
+     */
+    struct ScopedTiming
+    {
+        explicit ScopedTiming(RollingTimings *timings);
+
+        ~ScopedTiming();
+
+      private:
+        RollingTimings *timings;
+        std::chrono::steady_clock::time_point start;
+    };
+}
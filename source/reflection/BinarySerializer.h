@@ -0,0 +1,91 @@
+#pragma once
+#include "ComponentInfo.h"
+#include "StructInfo.h"
+
+#include <utils/gu_error.h>
+
+#include <entt/entity/registry.hpp>
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace dibidab
+{
+    /**
+     * True if the component is saved to Json with all of its variables,
+     * so that saving all of its bytes instead does not save anything that Json would not.
+     */
+    inline bool canSaveAllBytes(const ComponentInfo &info)
+    {
+        const StructInfo *structInfo = findStructInfo(info.structId);
+        if (structInfo == nullptr || info.getJsonArray == nullptr || info.setFromJson == nullptr)
+        {
+            return false;
+        }
+        for (const VariableInfo &variable : structInfo->variables)
+        {
+            if (!variable.bJsonExposed)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * True if the component can be saved byte for byte: equal components must have equal bytes, so that saves are deterministic
+     * and unchanged components hash the same (see `level/room/EntityColumns.h`).
+     * Components with padding (which is not initialized) or floating point variables (-0.0 == 0.0) are saved as CBOR instead.
+     */
+    template <typename Component>
+    constexpr bool canCopyBytes = std::is_trivially_copyable_v<Component>
+        && (std::is_empty_v<Component> || std::has_unique_object_representations_v<Component>);
+
+    /**
+     * Registers a binary serializer for a component that can be copied byte for byte, see `canCopyBytes`.
+     * The binary form is only valid for the same build/platform, level files use native byte order anyway.
+     * Changes to the variables of the component are detected when loading, see `level/room/EntityColumns.h`.
+     */
+    template <typename Component>
+    void registerTriviallyCopyableBinarySerializer()
+    {
+        static_assert(canCopyBytes<Component>, "Component cannot be copied byte for byte");
+
+        setBinarySerializer(
+            typename_utils::getTypeName<Component>().c_str(),
+            [] (entt::entity entity, const entt::registry &registry, std::vector<unsigned char> &out)
+            {
+                if constexpr (!std::is_empty_v<Component>)
+                {
+                    const auto *bytes = reinterpret_cast<const unsigned char *>(&registry.get<Component>(entity));
+                    out.insert(out.end(), bytes, bytes + sizeof(Component));
+                }
+            },
+            [] (const unsigned char *data, size_t size, entt::entity entity, entt::registry &registry) -> size_t
+            {
+                if constexpr (std::is_empty_v<Component>)
+                {
+                    registry.assign_or_replace<Component>(entity);
+                    return 0;
+                }
+                else
+                {
+                    if (size < sizeof(Component))
+                    {
+                        throw gu_err("Not enough binary data for " + typename_utils::getTypeName<Component>());
+                    }
+                    Component component;
+                    std::memcpy(&component, data, sizeof(Component));
+                    registry.assign_or_replace<Component>(entity, component);
+                    return sizeof(Component);
+                }
+            },
+            [] (entt::registry &registry, size_t count)
+            {
+                registry.reserve<Component>(registry.size<Component>() + count);
+            },
+            std::is_empty_v<Component> ? 0 : sizeof(Component)
+        );
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "BinarySerializer.h"
+#include "ComponentInfo.h"
+#include "LuaComponent.h"
+
+#include <entt/entity/registry.hpp>
+
+#include <type_traits>
+
+namespace dibidab
+{
+    /**
+     * Registers `ComponentInfo::copyComponent` for a component.
+     */
+    template <typename Component>
+    void registerComponentCopy()
+    {
+        static_assert(std::is_copy_constructible_v<Component>, "Component cannot be copied");
+
+        setComponentCopy(
+            typename_utils::getTypeName<Component>().c_str(),
+            [] (entt::entity from, const entt::registry &fromRegistry, entt::entity to, entt::registry &toRegistry)
+            {
+                if constexpr (std::is_empty_v<Component>)
+                {
+                    toRegistry.assign_or_replace<Component>(to);
+                }
+                else
+                {
+                    toRegistry.assign_or_replace<Component>(to, fromRegistry.get<Component>(from));
+                }
+            }
+        );
+    }
+
+    /**
+     * Fills the optional functions of `ComponentInfo` that need the type of the component for each of the (already registered)
+     * `Components`, because the generated reflection code does not provide them:
+     *  - `copyComponent` and `emplaceFromLua`, if the component is copy constructible.
+     *  - The binary serializer, if the bytes of the component fully describe its value (see `canCopyBytes`)
+     *    and all of its variables are exposed to Json (see `canSaveAllBytes()`). Otherwise Rooms save the component through Json (as CBOR).
+     *
+     * dibidab calls this for its own components in `initCore()`. Games should call it for their own components after that,
+     * saving a Room warns about persistent components for which it was not called.
+     */
+    template <typename... Components>
+    void registerComponentFunctions()
+    {
+        ([]
+        {
+            if constexpr (std::is_copy_constructible_v<Components>)
+            {
+                registerComponentCopy<Components>();
+                registerLuaEmplace<Components>();
+            }
+            if constexpr (canCopyBytes<Components>)
+            {
+                const ComponentInfo *info = findComponentInfo<Components>();
+                if (info != nullptr && canSaveAllBytes(*info))
+                {
+                    registerTriviallyCopyableBinarySerializer<Components>();
+                }
+            }
+            setComponentFunctionsRegistered(typename_utils::getTypeName<Components>().c_str());
+        }(), ...);
+    }
+}
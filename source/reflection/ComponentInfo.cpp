@@ -38,3 +38,61 @@ void dibidab::registerComponentInfo(const dibidab::ComponentInfo &info)
     }
     ::getAllComponentInfos().insert({ info.name, info });
 }
+
+void dibidab::setBinarySerializer(
+    const char *componentName,
+    void (*appendBinary)(entt::entity, const entt::registry &, std::vector<unsigned char> &),
+    size_t (*setFromBinary)(const unsigned char *, size_t, entt::entity, entt::registry &),
+    void (*reserve)(entt::registry &, size_t),
+    size_t binarySize
+)
+{
+    auto &infos = ::getAllComponentInfos();
+    auto it = infos.find(componentName);
+    if (it == infos.end())
+    {
+        throw gu_err(std::string("Cannot set binary serializer of unregistered component ") + componentName);
+    }
+    it->second.appendBinary = appendBinary;
+    it->second.setFromBinary = setFromBinary;
+    it->second.reserve = reserve;
+    it->second.binarySize = binarySize;
+}
+
+void dibidab::setLuaEmplace(
+    const char *componentName, void (*emplaceFromLua)(const sol::table &, entt::entity, entt::registry &)
+)
+{
+    auto &infos = ::getAllComponentInfos();
+    auto it = infos.find(componentName);
+    if (it == infos.end())
+    {
+        throw gu_err(std::string("Cannot set Lua emplace function of unregistered component ") + componentName);
+    }
+    it->second.emplaceFromLua = emplaceFromLua;
+}
+
+void dibidab::setComponentCopy(
+    const char *componentName,
+    void (*copyComponent)(entt::entity, const entt::registry &, entt::entity, entt::registry &)
+)
+{
+    auto &infos = ::getAllComponentInfos();
+    auto it = infos.find(componentName);
+    if (it == infos.end())
+    {
+        throw gu_err(std::string("Cannot set copy function of unregistered component ") + componentName);
+    }
+    it->second.copyComponent = copyComponent;
+}
+
+void dibidab::setComponentFunctionsRegistered(const char *componentName)
+{
+    auto &infos = ::getAllComponentInfos();
+    auto it = infos.find(componentName);
+    if (it == infos.end())
+    {
+        throw gu_err(std::string("Cannot register functions of unregistered component ") + componentName);
+    }
+    it->second.bFunctionsRegistered = true;
+}
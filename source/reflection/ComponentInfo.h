@@ -6,7 +6,9 @@
 #include <json_fwd.hpp>
 #include <sol/forward.hpp>
 
+#include <cstddef>
 #include <map>
+#include <vector>
 
 namespace dibidab
 {
@@ -57,7 +59,55 @@ namespace dibidab
         void (*patchFromJson)(const json &objectOrArray, entt::entity, entt::registry &);
 
         void (*setFromLua)(const sol::table &, entt::entity, entt::registry &);
+
+        /**
+         *  Same as `setFromLua`, but copy-constructs the component in the registry straight from the Lua object,
+         *  instead of first copying the Lua object to a temporary.
+         *  NOTE: function is nullptr if not set! See `registerLuaEmplace()` in `LuaComponent.h`.
+         */
+        void (*emplaceFromLua)(const sol::table &, entt::entity, entt::registry &) = nullptr;
+
         void (*fillLuaUtilsTable)(sol::table &, entt::registry &, const ComponentInfo *);
+
+        /**
+         *  Copy-constructs the component of entity `from` (check presence first with `hasComponent`!) onto entity `to`,
+         *  which can be in another registry. Used to stamp prefabs, see `LuaTemplate`.
+         *  NOTE: function is nullptr if not set! See `registerComponentFunctions()` in `ComponentFunctions.h`.
+         */
+        void (*copyComponent)(entt::entity from, const entt::registry &, entt::entity to, entt::registry &) = nullptr;
+
+        /**
+         *  Gets the component on the entity (check presence first with `hasComponent`!)
+         *  and appends it to `out` in a compact binary form. Used for saving Rooms, see `level/room/EntityColumns.h`.
+         *  NOTE: function is nullptr if component has no binary serializer! See `setBinarySerializer()`.
+         */
+        void (*appendBinary)(entt::entity, const entt::registry &, std::vector<unsigned char> &out) = nullptr;
+
+        /**
+         *  Sets/replaces the component on the entity from the binary form at `data`.
+         *  Returns the number of bytes that were read. Throws if `size` is too small.
+         *  NOTE: function is nullptr if component has no binary serializer! See `setBinarySerializer()`.
+         */
+        size_t (*setFromBinary)(const unsigned char *data, size_t size, entt::entity, entt::registry &) = nullptr;
+
+        /**
+         *  Reserves space for `count` more of this component, before many are added at once (when loading a Room for example).
+         *  NOTE: function is nullptr if not set! See `setBinarySerializer()`.
+         */
+        void (*reserve)(entt::registry &, size_t count) = nullptr;
+
+        /**
+         *  Size of the binary form of the component, part of its layout hash (see `level/room/EntityColumns.h`),
+         *  so that binary data saved by a build with another layout is not loaded.
+         *  NOTE: 0 if the component has no binary serializer, or if its binary form has no fixed size. See `setBinarySerializer()`.
+         */
+        size_t binarySize = 0;
+
+        /**
+         *  True if `registerComponentFunctions()` (see `ComponentFunctions.h`) was called for the component.
+         *  Rooms warn when saving a component for which it was not, because it is saved less efficiently than it could be.
+         */
+        bool bFunctionsRegistered = false;
     };
 
     const std::map<std::string, ComponentInfo> &getAllComponentInfos();
@@ -73,4 +123,34 @@ namespace dibidab
     const ComponentInfo *getInfoFromUtilsTable(const sol::table &);
 
     void registerComponentInfo(const ComponentInfo &);
+
+    /**
+     * Sets the binary serializer (and optionally `ComponentInfo::reserve`) of an already registered component.
+     * Trivially copyable components get one from `registerComponentFunctions()` in `ComponentFunctions.h`.
+     */
+    void setBinarySerializer(
+        const char *componentName,
+        void (*appendBinary)(entt::entity, const entt::registry &, std::vector<unsigned char> &),
+        size_t (*setFromBinary)(const unsigned char *, size_t, entt::entity, entt::registry &),
+        void (*reserve)(entt::registry &, size_t) = nullptr,
+        size_t binarySize = 0
+    );
+
+    /**
+     * Sets `ComponentInfo::emplaceFromLua` of an already registered component. See `registerLuaEmplace()` in `LuaComponent.h`.
+     */
+    void setLuaEmplace(const char *componentName, void (*emplaceFromLua)(const sol::table &, entt::entity, entt::registry &));
+
+    /**
+     * Sets `ComponentInfo::copyComponent` of an already registered component. See `registerComponentFunctions()` in `ComponentFunctions.h`.
+     */
+    void setComponentCopy(
+        const char *componentName,
+        void (*copyComponent)(entt::entity, const entt::registry &, entt::entity, entt::registry &)
+    );
+
+    /**
+     * Sets `ComponentInfo::bFunctionsRegistered` of an already registered component.
+     */
+    void setComponentFunctionsRegistered(const char *componentName);
 }
@@ -0,0 +1,27 @@
+#pragma once
+#include "ComponentInfo.h"
+
+#include <entt/entity/registry.hpp>
+#include <sol/sol.hpp>
+
+namespace dibidab
+{
+    /**
+     * Registers `ComponentInfo::emplaceFromLua` for a component, used by `Engine::setComponentFromLua()`.
+     * The component is copied directly from the Lua object into the registry, which is one copy instead of the two of `setFromLua`.
+     * It is not moved, because Lua may still reference the object, for example when a script passes the same one to several entities.
+     * Called for all copy constructible components by `registerComponentFunctions()` in `ComponentFunctions.h`.
+     */
+    template <typename Component>
+    void registerLuaEmplace()
+    {
+        setLuaEmplace(
+            typename_utils::getTypeName<Component>().c_str(),
+            [] (const sol::table &component, entt::entity entity, entt::registry &registry)
+            {
+                const Component &fromLua = component.as<const Component &>();
+                registry.assign_or_replace<Component>(entity, fromLua);
+            }
+        );
+    }
+}
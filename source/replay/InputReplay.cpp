@@ -0,0 +1,347 @@
+#include "InputReplay.h"
+
+#include <input/key_input.h>
+#include <input/gamepad_input.h>
+#include <files/file_utils.h>
+#include <utils/gu_error.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <random>
+
+/*
+ * Binary format (native byte order):
+ *
+ * Header:
+ *  char[4]     "DBRP"
+ *  uint8       version
+ *  uint32      seed for std::srand()
+ *
+ * Followed by frames until the end of the file (a truncated last frame is ignored):
+ *  float64     deltaTime
+ *  uint16      number of events
+ *  events:
+ *      uint8   InputEvent::Type
+ *      uint8   gamepad
+ *      int16   code
+ *      float32 value (only for InputEvent::Type::Axis)
+ */
+
+namespace
+{
+    constexpr char MAGIC[4] = { 'D', 'B', 'R', 'P' };
+    constexpr uint8_t VERSION = 1;
+
+    enum class Mode
+    {
+        Off,
+        Recording,
+        Replaying
+    };
+
+    using dibidab::replay::InputEvent;
+
+    // Queries can come from Systems updated on worker threads:
+    std::mutex mutex;
+    std::atomic<Mode> mode { Mode::Off };
+
+    std::ofstream recordingStream;
+    // The frame that is being recorded, written to the file as a whole in endFrame():
+    std::vector<uint8_t> frameBuffer;
+
+    std::vector<uint8_t> replayData;
+    size_t replayReadOffset = 0;
+
+    std::vector<InputEvent> currentFrameEvents;
+    uint64_t nrOfFrames = 0;
+
+    template<typename Type>
+    void write(const Type &value)
+    {
+        const uint8_t *bytes = (const uint8_t *) &value;
+        frameBuffer.insert(frameBuffer.end(), bytes, bytes + sizeof(Type));
+    }
+
+    template<typename Type>
+    bool tryRead(Type &outValue)
+    {
+        if (replayReadOffset + sizeof(Type) > replayData.size())
+        {
+            return false;
+        }
+        std::memcpy(&outValue, &replayData[replayReadOffset], sizeof(Type));
+        replayReadOffset += sizeof(Type);
+        return true;
+    }
+
+    template<typename Type>
+    Type read()
+    {
+        Type value;
+        if (!tryRead(value))
+        {
+            throw gu_err("Unexpected end of input recording");
+        }
+        return value;
+    }
+
+    /**
+     * Returns false if the recording ended in the middle of the frame, which happens if the game crashed while writing it.
+     */
+    bool tryReadFrame(double &outDeltaTime)
+    {
+        uint16_t nrOfEvents = 0;
+        if (!tryRead(outDeltaTime) || !tryRead(nrOfEvents))
+        {
+            return false;
+        }
+        currentFrameEvents.resize(nrOfEvents);
+        for (InputEvent &event : currentFrameEvents)
+        {
+            uint8_t type = 0;
+            if (!tryRead(type) || !tryRead(event.gamepad) || !tryRead(event.code))
+            {
+                return false;
+            }
+            event.type = InputEvent::Type(type);
+            event.value = 0.0f;
+            if (event.type == InputEvent::Type::Axis && !tryRead(event.value))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const InputEvent *findEvent(InputEvent::Type type, unsigned int gamepad, int code)
+    {
+        for (const InputEvent &event : currentFrameEvents)
+        {
+            if (event.type == type && event.gamepad == gamepad && event.code == code)
+            {
+                return &event;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Returns the live state while not replaying (and records it if true while recording),
+     * or whether the event was recorded while replaying.
+     */
+    bool queryTransition(InputEvent::Type type, unsigned int gamepad, int code, const std::function<bool()> &liveQuery)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (mode == Mode::Replaying)
+        {
+            return findEvent(type, gamepad, code) != nullptr;
+        }
+        const bool bLive = liveQuery();
+        if (bLive && mode == Mode::Recording && findEvent(type, gamepad, code) == nullptr)
+        {
+            currentFrameEvents.push_back({ type, uint8_t(gamepad), int16_t(code) });
+        }
+        return bLive;
+    }
+}
+
+void dibidab::replay::startRecording(const char *path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mode != Mode::Off)
+    {
+        throw gu_err("Cannot start recording while already recording or replaying");
+    }
+    recordingStream.open(path, std::ios::binary | std::ios::trunc);
+    if (!recordingStream)
+    {
+        throw gu_err("Could not open " + std::string(path) + " for recording");
+    }
+    const uint32_t seed = std::random_device()();
+    std::srand(seed);
+
+    frameBuffer.assign(MAGIC, MAGIC + sizeof(MAGIC));
+    write(VERSION);
+    write(seed);
+    recordingStream.write((const char *) frameBuffer.data(), frameBuffer.size());
+    recordingStream.flush();
+
+    currentFrameEvents.clear();
+    nrOfFrames = 0;
+    mode = Mode::Recording;
+}
+
+void dibidab::replay::stopRecording()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mode == Mode::Recording)
+    {
+        recordingStream.close();
+        mode = Mode::Off;
+    }
+}
+
+bool dibidab::replay::isRecording()
+{
+    return mode == Mode::Recording;
+}
+
+void dibidab::replay::startReplaying(const char *path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mode != Mode::Off)
+    {
+        throw gu_err("Cannot start replaying while already recording or replaying");
+    }
+    replayData = fu::readBinary(path);
+    replayReadOffset = 0;
+
+    char magic[sizeof(MAGIC)];
+    for (char &c : magic)
+    {
+        c = read<char>();
+    }
+    if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        throw gu_err(std::string(path) + " is not an input recording");
+    }
+    const uint8_t version = read<uint8_t>();
+    if (version != VERSION)
+    {
+        throw gu_err(std::string(path) + " has an unsupported input recording version: " + std::to_string(version));
+    }
+    std::srand(read<uint32_t>());
+
+    currentFrameEvents.clear();
+    nrOfFrames = 0;
+    mode = Mode::Replaying;
+}
+
+void dibidab::replay::stopReplaying()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mode == Mode::Replaying)
+    {
+        replayData.clear();
+        replayData.shrink_to_fit();
+        currentFrameEvents.clear();
+        mode = Mode::Off;
+    }
+}
+
+bool dibidab::replay::isReplaying()
+{
+    return mode == Mode::Replaying;
+}
+
+bool dibidab::replay::nextReplayFrame(double &deltaTime)
+{
+    if (mode != Mode::Replaying)
+    {
+        return false;
+    }
+    bool bFrameRead = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bFrameRead = tryReadFrame(deltaTime);
+    }
+    if (!bFrameRead)
+    {
+        stopReplaying();
+        return false;
+    }
+    nrOfFrames++;
+    return true;
+}
+
+uint64_t dibidab::replay::getNrOfFrames()
+{
+    return nrOfFrames;
+}
+
+void dibidab::replay::beginFrame(double deltaTime)
+{
+    if (mode != Mode::Recording)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    currentFrameEvents.clear();
+    frameBuffer.clear();
+    write(deltaTime);
+}
+
+void dibidab::replay::endFrame()
+{
+    if (mode != Mode::Recording)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const size_t nrOfEvents = std::min<size_t>(currentFrameEvents.size(), std::numeric_limits<uint16_t>::max());
+    write(uint16_t(nrOfEvents));
+    for (size_t i = 0; i < nrOfEvents; i++)
+    {
+        const InputEvent &event = currentFrameEvents[i];
+        write(uint8_t(event.type));
+        write(event.gamepad);
+        write(event.code);
+        if (event.type == InputEvent::Type::Axis)
+        {
+            write(event.value);
+        }
+    }
+    recordingStream.write((const char *) frameBuffer.data(), frameBuffer.size());
+    recordingStream.flush();
+    frameBuffer.clear();
+    nrOfFrames++;
+}
+
+bool dibidab::replay::keyJustPressed(int key)
+{
+    return queryTransition(InputEvent::Type::KeyPressed, 0, key, [&] { return KeyInput::justPressed(key); });
+}
+
+bool dibidab::replay::keyJustReleased(int key)
+{
+    return queryTransition(InputEvent::Type::KeyReleased, 0, key, [&] { return KeyInput::justReleased(key); });
+}
+
+bool dibidab::replay::buttonJustPressed(unsigned int gamepad, int button)
+{
+    return queryTransition(InputEvent::Type::ButtonPressed, gamepad, button, [&]
+    {
+        return GamepadInput::justPressed(gamepad, button);
+    });
+}
+
+bool dibidab::replay::buttonJustReleased(unsigned int gamepad, int button)
+{
+    return queryTransition(InputEvent::Type::ButtonReleased, gamepad, button, [&]
+    {
+        return GamepadInput::justReleased(gamepad, button);
+    });
+}
+
+float dibidab::replay::getGamepadAxis(unsigned int gamepad, int axis)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const InputEvent *recorded = findEvent(InputEvent::Type::Axis, gamepad, axis);
+    if (mode == Mode::Replaying)
+    {
+        return recorded ? recorded->value : 0.0f;
+    }
+    const float value = GamepadInput::getAxis(gamepad, axis);
+    if (mode == Mode::Recording && recorded == nullptr && value != 0.0f)
+    {
+        currentFrameEvents.push_back({ InputEvent::Type::Axis, uint8_t(gamepad), int16_t(axis), value });
+    }
+    return value;
+}
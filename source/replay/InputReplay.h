@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Records the delta time passed to every `Level::update()` call, and the input consumed during that update,
+ * so that a play session can be replayed exactly, without a window (see `headless::Config::replayPath`).
+ *
+ * Only input that is queried through the functions below is recorded/replayed. `KeyEventsSystem` and the Lua function
+ * `getGamepadAxis()` use these, custom Systems should use these instead of `KeyInput`/`GamepadInput` to be replayable.
+ *
+ * NOTE: a replay is only as deterministic as the game: it seeds `std::rand()` with the seed stored in the recording,
+ * but other sources of randomness or timing dependent behavior will make the replay diverge.
+ */
+namespace dibidab::replay
+{
+    struct InputEvent
+    {
+        enum class Type : uint8_t
+        {
+            KeyPressed,
+            KeyReleased,
+            ButtonPressed,
+            ButtonReleased,
+            Axis
+        };
+
+        Type type = Type::KeyPressed;
+        uint8_t gamepad = 0;
+        int16_t code = 0;   // GLFW key, button or axis.
+        float value = 0.0f; // Only used by Axis.
+    };
+
+    /**
+     * Starts writing frames to `path`. Frames are written as a whole when they end, so the file is usable even if the game crashes.
+     * A frame that was only partially written (because the game crashed while writing it) is ignored when replaying.
+     */
+    void startRecording(const char *path);
+
+    void stopRecording();
+
+    bool isRecording();
+
+    /**
+     * Loads the recording at `path` completely into memory. Use `nextReplayFrame()` to step through it.
+     */
+    void startReplaying(const char *path);
+
+    void stopReplaying();
+
+    bool isReplaying();
+
+    /**
+     * Makes the input of the next recorded frame available to the query functions below.
+     * Returns false (and stops replaying) if there are no frames left.
+     *
+     * @param deltaTime The recorded delta time that should be passed to `Level::update()`.
+     */
+    bool nextReplayFrame(double &deltaTime);
+
+    uint64_t getNrOfFrames();
+
+    /**
+     * Called by `Level::update()`. While recording, everything queried between these calls is stored as one frame.
+     */
+    void beginFrame(double deltaTime);
+
+    void endFrame();
+
+    // Input queries that return the recorded input while replaying, and record the live input while recording:
+
+    bool keyJustPressed(int key);
+
+    bool keyJustReleased(int key);
+
+    bool buttonJustPressed(unsigned int gamepad, int button);
+
+    bool buttonJustReleased(unsigned int gamepad, int button);
+
+    float getGamepadAxis(unsigned int gamepad, int axis);
+}
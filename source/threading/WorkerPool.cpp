@@ -0,0 +1,282 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+namespace
+{
+    thread_local bool bIsWorkerThread = false;
+
+    // Static initialization happens on the thread that starts the program:
+    std::atomic<std::thread::id> mainThreadId { std::this_thread::get_id() };
+
+    struct MainThreadTask
+    {
+        const std::function<void()> *function = nullptr;
+        bool bDone = false;
+        std::exception_ptr exception;
+    };
+
+    std::mutex mainThreadMutex;
+    // Notified when a task is queued for the main thread, or when a TaskGroup finished:
+    std::condition_variable mainThreadCondition;
+    // Notified when a task queued for the main thread is done:
+    std::condition_variable mainThreadTaskDoneCondition;
+    std::deque<MainThreadTask *> mainThreadTasks;
+
+    bool runQueuedMainThreadTask()
+    {
+        MainThreadTask *task;
+        {
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+            if (mainThreadTasks.empty())
+            {
+                return false;
+            }
+            task = mainThreadTasks.front();
+            mainThreadTasks.pop_front();
+        }
+        try
+        {
+            (*task->function)();
+        }
+        catch (...)
+        {
+            task->exception = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+            task->bDone = true;
+        }
+        mainThreadTaskDoneCondition.notify_all();
+        return true;
+    }
+
+    void notifyMainThread()
+    {
+        // Lock, so that a main thread that is about to wait cannot miss the notification:
+        {
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+        }
+        mainThreadCondition.notify_all();
+    }
+}
+
+bool dibidab::threading::isWorkerThread()
+{
+    return bIsWorkerThread;
+}
+
+void dibidab::threading::setMainThread()
+{
+    mainThreadId = std::this_thread::get_id();
+}
+
+bool dibidab::threading::isMainThread()
+{
+    return std::this_thread::get_id() == mainThreadId.load();
+}
+
+void dibidab::threading::runOnMainThread(const std::function<void()> &task)
+{
+    if (isMainThread())
+    {
+        task();
+        return;
+    }
+    MainThreadTask mainThreadTask;
+    mainThreadTask.function = &task;
+    {
+        std::unique_lock<std::mutex> lock(mainThreadMutex);
+        mainThreadTasks.push_back(&mainThreadTask);
+        mainThreadCondition.notify_all();
+        mainThreadTaskDoneCondition.wait(lock, [&]
+        {
+            return mainThreadTask.bDone;
+        });
+    }
+    if (mainThreadTask.exception)
+    {
+        std::rethrow_exception(mainThreadTask.exception);
+    }
+}
+
+dibidab::threading::WorkerPool::WorkerPool(int nrOfThreads)
+{
+    for (int i = 0; i < nrOfThreads; i++)
+    {
+        threads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+int dibidab::threading::WorkerPool::getNrOfThreads() const
+{
+    return int(threads.size());
+}
+
+void dibidab::threading::WorkerPool::submit(std::function<void()> task)
+{
+    if (threads.empty())
+    {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back(std::move(task));
+    }
+    queueCondition.notify_one();
+}
+
+bool dibidab::threading::WorkerPool::tryRunQueuedTask()
+{
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (queue.empty())
+        {
+            return false;
+        }
+        task = std::move(queue.front());
+        queue.pop_front();
+    }
+    task();
+    return true;
+}
+
+dibidab::threading::WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        bStopping = true;
+    }
+    queueCondition.notify_all();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+int dibidab::threading::WorkerPool::getDefaultNrOfThreads()
+{
+    // One hardware thread is left for the thread that submits the tasks:
+    return std::max(0, int(std::thread::hardware_concurrency()) - 1);
+}
+
+void dibidab::threading::WorkerPool::workerLoop()
+{
+    bIsWorkerThread = true;
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [&]
+            {
+                return bStopping || !queue.empty();
+            });
+            if (queue.empty())
+            {
+                return; // stopping
+            }
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        task();
+    }
+}
+
+dibidab::threading::TaskGroup::TaskGroup(WorkerPool *pool) :
+    pool(pool)
+{
+}
+
+void dibidab::threading::TaskGroup::run(std::function<void()> task)
+{
+    nrOfUnfinishedTasks++;
+
+    auto wrappedTask = [this, task = std::move(task)]
+    {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(exceptionMutex);
+            if (!firstException)
+            {
+                firstException = std::current_exception();
+            }
+        }
+        // Lock, so that wait() cannot miss the notification:
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        if (--nrOfUnfinishedTasks == 0)
+        {
+            finishedCondition.notify_all();
+            notifyMainThread();
+        }
+    };
+
+    if (pool == nullptr)
+    {
+        wrappedTask();
+    }
+    else
+    {
+        pool->submit(std::move(wrappedTask));
+    }
+}
+
+void dibidab::threading::TaskGroup::wait()
+{
+    waitUntilFinished();
+
+    std::exception_ptr exception;
+    {
+        std::lock_guard<std::mutex> lock(exceptionMutex);
+        std::swap(exception, firstException);
+    }
+    if (exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+dibidab::threading::TaskGroup::~TaskGroup()
+{
+    // Tasks reference this group, never let them outlive it:
+    waitUntilFinished();
+}
+
+void dibidab::threading::TaskGroup::waitUntilFinished()
+{
+    // Other threads (like the thread of an asynchronous save) never run the tasks queued for the main thread:
+    const bool bMainThread = isMainThread();
+    while (nrOfUnfinishedTasks > 0)
+    {
+        if (bMainThread && runQueuedMainThreadTask())
+        {
+            continue;
+        }
+        if (pool != nullptr && pool->tryRunQueuedTask())
+        {
+            continue;
+        }
+        if (bMainThread)
+        {
+            std::unique_lock<std::mutex> lock(mainThreadMutex);
+            mainThreadCondition.wait(lock, [&]
+            {
+                return nrOfUnfinishedTasks == 0 || !mainThreadTasks.empty();
+            });
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(finishedMutex);
+        finishedCondition.wait(lock, [&]
+        {
+            return nrOfUnfinishedTasks == 0;
+        });
+    }
+    // The last task might still hold the lock after decrementing the counter:
+    std::lock_guard<std::mutex> lock(finishedMutex);
+}
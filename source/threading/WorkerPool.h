@@ -0,0 +1,111 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <vector>
+#include <deque>
+
+namespace dibidab::threading
+{
+    /**
+     * Returns true if called from one of the threads owned by a WorkerPool.
+     * Useful for skipping things that are not thread-safe, like profiler zones.
+     */
+    bool isWorkerThread();
+
+    /**
+     * Makes the calling thread the main thread: the thread that runs the game loop, and may use Lua and the AssetManager.
+     * Called by `initCore()`. Until then, the main thread is the thread that started the program.
+     */
+    void setMainThread();
+
+    /**
+     * Returns true if called from the main thread (see `setMainThread()`).
+     * Other threads that are not owned by a WorkerPool, like the thread of `Level::saveAsync()`, are not the main thread either.
+     */
+    bool isMainThread();
+
+    /**
+     * Runs the task on the main thread (see `setMainThread()`), and waits for it to finish.
+     * Called from the main thread, the task is executed right away. Called from another thread, the task is executed
+     * by the main thread while it waits for a TaskGroup. So only call this from tasks that the main thread waits for.
+     * Exceptions thrown by the task are rethrown by this function.
+     */
+    void runOnMainThread(const std::function<void()> &task);
+
+    /**
+     * A fixed set of worker threads that execute queued tasks.
+     *
+     * A pool with 0 threads is valid, all tasks will then be executed by the thread that waits for them.
+     */
+    class WorkerPool
+    {
+      public:
+        explicit WorkerPool(int nrOfThreads);
+
+        int getNrOfThreads() const;
+
+        /**
+         * Queues a task without waiting for it. Use a TaskGroup if you need to know when the task is done.
+         */
+        void submit(std::function<void()> task);
+
+        /**
+         * Executes one queued task on the calling thread, if any.
+         * Returns false if the queue was empty.
+         */
+        bool tryRunQueuedTask();
+
+        ~WorkerPool();
+
+        /**
+         * Returns the number of threads a pool should have to keep all hardware threads busy, including the calling thread.
+         */
+        static int getDefaultNrOfThreads();
+
+      private:
+        void workerLoop();
+
+        std::vector<std::thread> threads;
+        std::deque<std::function<void()>> queue;
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        bool bStopping = false;
+    };
+
+    /**
+     * Runs tasks on a WorkerPool and waits for all of them to finish.
+     *
+     * While waiting, the waiting thread helps executing queued tasks,
+     * so TaskGroups can safely be used from within other tasks of the same pool.
+     * The main thread also executes the tasks queued by `runOnMainThread()` while waiting.
+     * The first exception thrown by a task is rethrown by `wait()`.
+     */
+    class TaskGroup
+    {
+      public:
+        explicit TaskGroup(WorkerPool *pool);
+
+        void run(std::function<void()> task);
+
+        void wait();
+
+        ~TaskGroup();
+
+      private:
+        void waitUntilFinished();
+
+        WorkerPool *pool;
+
+        std::atomic<int> nrOfUnfinishedTasks { 0 };
+        std::mutex finishedMutex;
+        std::condition_variable finishedCondition;
+
+        std::mutex exceptionMutex;
+        std::exception_ptr firstException;
+    };
+}